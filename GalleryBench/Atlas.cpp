@@ -0,0 +1,63 @@
+#include "GalleryBench.h"
+
+// Sprite-sheet export, then the round trip: both index forms are read back and every rect
+// is cut out of the sheet into an IconGalleryCtrl with SetThumbImage. The sub-images must
+// match what GalleryExporter::Render produces for the same item and size, pixel for pixel;
+// any difference sets exit code 1.
+void BenchAtlas()
+{
+    const int N = 1000, SRC = 96;
+    Vector<GalleryExportItem> items;
+    Vector<String> names;
+    for(int i = 0; i < N; ++i) {
+        GalleryExportItem& e = items.Add();
+        e.name = Format("icon %d", i);
+        e.seed = HsvColorf((i % 36) / 36.0, 0.6, 0.9);
+        if(i % 3) // the rest stay generated tiles
+            e.src = BenchSource(Size(SRC, SRC), i);
+        names.Add(e.name);
+    }
+    Vector<int> sizes = { 16, 32, 64, 128, 256 };
+
+    String dir = AppendFileName(GetTempPath(), "gallerybench_atlas");
+    bool written = false;
+    int64 us = BenchBest(3, [&] { written = GalleryExportAtlas(items, sizes, dir); });
+    Cout() << Format("atlas %d icons x %d sizes: %.1f ms (%.0f icons/s)%s\n", N, sizes.GetCount(),
+                     us / 1000.0, N * 1e6 / us, written ? "" : ", WRITE FAILED");
+
+    for(int px : sizes) {
+        String base = AppendFileName(dir, Format("atlas_%d", px));
+        GalleryAtlasIndex json, bin;
+        bool loaded = json.LoadJson(LoadFile(base + ".json")) && bin.LoadBinary(LoadFile(base + ".igat"));
+        bool same = loaded && json.px == bin.px && json.size == bin.size && json.image == bin.image &&
+                    json.entry.GetCount() == N && bin.entry.GetCount() == N;
+        for(int i = 0; same && i < json.entry.GetCount(); ++i)
+            same = json.entry[i].name == bin.entry[i].name && json.entry[i].rect == bin.entry[i].rect;
+
+        Image sheet = StreamRaster::LoadFileAny(AppendFileName(dir, json.image));
+        IconGalleryCtrl g;
+        g.AddRange(names);
+        int64 t0 = usecs();
+        for(int i = 0; i < json.entry.GetCount(); ++i)
+            g.SetThumbImage(i, Crop(sheet, json.entry[i].rect));
+        int64 load_us = usecs() - t0;
+
+        int bad = 0;
+        for(int i = 0; i < N; ++i) {
+            Image a = g.GetItem(i).GetSource();
+            Image b = GalleryExporter::Render(items[i], items[i].src, px);
+            if(a.GetSize() != b.GetSize() || memcmp(~a, ~b, a.GetLength() * sizeof(RGBA)))
+                bad++;
+        }
+        Cout() << Format("atlas %3d px: sheet %dx%d (%.0f%% used), %s index, %d KB binary vs %d KB JSON, "
+                         "%d sub-images in %.2f ms, %s\n",
+                         px, json.size.cx, json.size.cy,
+                         100.0 * N * px * px / max(json.size.cx * json.size.cy, 1),
+                         same ? "matching" : "MISMATCHED",
+                         (int)GetFileLength(base + ".igat") >> 10, (int)GetFileLength(base + ".json") >> 10,
+                         json.entry.GetCount(), load_us / 1000.0,
+                         bad ? Format("%d PIXEL MISMATCHES", bad) : String("round trip ok"));
+        if(!written || !same || bad)
+            SetExitCode(1);
+    }
+}
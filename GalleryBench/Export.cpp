@@ -0,0 +1,38 @@
+#include "GalleryBench.h"
+
+// GalleryExporter throughput: icons/s against the worker count, decoding 512px PNG sources
+// and writing all five output sizes. Peak heap growth should track threads, not N.
+void BenchExport()
+{
+    const int N = 200, SRC = 512;
+    const int sizes[] = { 16, 32, 64, 128, 256 };
+    String src = AppendFileName(GetTempPath(), "gallerybench_export_src");
+    RealizeDirectory(src);
+    Vector<GalleryExportItem> items;
+    for(int i = 0; i < N; ++i) {
+        String fn = AppendFileName(src, Format("icon%04d.png", i));
+        if(!FileExists(fn))
+            PNGEncoder().SaveFile(fn, BenchSource(Size(SRC, SRC), i));
+        GalleryExportItem& e = items.Add();
+        e.name = GetFileTitle(fn);
+        e.src_path = fn;
+    }
+    Vector<int> px;
+    for(int s : sizes) px.Add(s);
+
+    String out = AppendFileName(GetTempPath(), "gallerybench_export_out");
+    for(int threads : { 1, 2, 4, 8 }) {
+        GalleryExporter x;
+        int64 mem0 = MemoryUsedKb(), peak = mem0;
+        int64 t0 = usecs();
+        x.Start(clone(items), px, out, threads);
+        while(x.GetDone() < x.GetTotal()) {
+            peak = max(peak, (int64)MemoryUsedKb());
+            Sleep(2);
+        }
+        x.Wait();
+        int64 us = max(usecs() - t0, (int64)1);
+        Cout() << Format("export threads %d: %6.1f icons/s, %d files, %d failed, peak +%d KB\n",
+                         threads, N * 1e6 / us, x.GetDone(), x.GetFailed(), (int)(peak - mem0));
+    }
+}
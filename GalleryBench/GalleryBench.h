@@ -0,0 +1,56 @@
+#pragma once
+#include <IconGalleryCtrl/IconGalleryCtrl.h>
+#include <plugin/png/png.h>
+
+// Best-of-n wall time of fn in microseconds
+template <class F>
+int64 BenchBest(int n, F fn)
+{
+    int64 best = INT64_MAX;
+    for(int i = 0; i < n; ++i) {
+        int64 t0 = usecs();
+        fn();
+        best = min(best, usecs() - t0);
+    }
+    return best;
+}
+
+// Opaque gradient test image; seed shifts the colors, so sources of different items differ
+inline Image BenchSource(Size sz, int seed)
+{
+    ImageBuffer ib(sz);
+    RGBA *t = ib.Begin();
+    for(int y = 0; y < sz.cy; ++y)
+        for(int x = 0; x < sz.cx; ++x, ++t) {
+            t->r = byte(x * 255 / sz.cx + seed);
+            t->g = byte(y * 255 / sz.cy + 3 * seed);
+            t->b = byte((x ^ y) + (seed >> 4));
+            t->a = 255;
+        }
+    return ib;
+}
+
+// Paints offscreen and pumps the thumbnail timer until the workers are idle, then paints
+// the finished frame
+inline void PaintUntilIdle(IconGalleryCtrl& g, ImageDraw& iw)
+{
+    Ctrl& c = g; // Paint is public on Ctrl
+    do {
+        c.Paint(iw);
+        Ctrl::ProcessEvents(); // drain timer
+        Sleep(1);
+    }
+    while(g.IsThumbWorkPending());
+    c.Paint(iw);
+}
+
+void BenchGrayKernel();
+void BenchThumbCache();
+void BenchItemStore();
+void BenchSuite();
+void BenchExport();
+void BenchAtlas();
+void BenchLibrary();
+void BenchVirtual();
+void BenchResample();
+void BenchMemory();
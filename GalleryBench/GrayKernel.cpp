@@ -0,0 +1,39 @@
+#include "GalleryBench.h"
+
+// The per-pixel loop EnsureThumbs used before DesaturateRGBA
+static void GrayReference(RGBA *t, const RGBA *s, int n)
+{
+    for(int i = 0; i < n; ++i, ++s, ++t) {
+        int lum = (s->r*30 + s->g*59 + s->b*11) / 100;
+        t->r = t->g = t->b = (byte)lum;
+        t->a = s->a;
+    }
+}
+
+void BenchGrayKernel()
+{
+    for(int tile : { 32, 64, 128 }) {
+        ImageBuffer src(tile, tile);
+        dword seed = 1;
+        RGBA *c = src.Begin();
+        for(int i = 0; i < tile * tile; ++i, ++c) {
+            seed = seed * 1664525 + 1013904223;
+            c->a = 255;
+            c->r = byte(seed >> 8);
+            c->g = byte(seed >> 16);
+            c->b = byte(seed >> 24);
+        }
+        Image m = src;
+        Buffer<RGBA> out(m.GetLength());
+        const int reps = 4 * 1024 * 1024 / (tile * tile); // ~4 Mpx per run
+        double mpx = double(reps) * tile * tile / 1e6;
+
+        int64 ref  = BenchBest(5, [&] { for(int i = 0; i < reps; ++i) GrayReference(~out, m.Begin(), tile * tile); });
+        int64 simd = BenchBest(5, [&] { for(int i = 0; i < reps; ++i) DesaturateRGBA(~out, m.Begin(), tile * tile); });
+        int64 half = BenchBest(5, [&] { for(int i = 0; i < reps; ++i) DesaturateRGBA(~out, m.Begin(), tile * tile, 128); });
+
+        Cout() << Format("gray %3d px: reference %7.1f Mpx/s, kernel %7.1f Mpx/s (x%.1f), 50%% blend %7.1f Mpx/s\n",
+                         tile, mpx * 1e6 / max<int64>(ref, 1), mpx * 1e6 / max<int64>(simd, 1),
+                         double(ref) / max<int64>(simd, 1), mpx * 1e6 / max<int64>(half, 1));
+    }
+}
@@ -0,0 +1,62 @@
+#include "GalleryBench.h"
+
+// The item layout before GalleryItemStore: one struct per item, every field inline
+struct LegacyItem : Moveable<LegacyItem> {
+    String      name;
+    Image       src;
+    String      src_path;
+    ThumbMip    mip[THUMB_MIP_SLOTS];
+    String      tags;
+    Color       seed;
+    bool        selected = false, filtered_out = false, thumb_queued = false, loading = false;
+    int         thumb_rev = 0;
+    ThumbStatus status = ThumbStatus::Auto;
+};
+
+// Bytes per item and the cost of a status/flag scan, array-of-structs vs the columnar store
+void BenchItemStore()
+{
+    for(int n : { 10000, 100000, 1000000 }) {
+        Vector<String> names;
+        names.Reserve(n);
+        for(int i = 0; i < n; ++i)
+            names.Add(Format(i & 1 ? "glyph_%d_outline" : "icon%d", i));
+
+        int64 mem0 = MemoryUsedKb();
+        Vector<LegacyItem> legacy;
+        legacy.SetCount(n);
+        for(int i = 0; i < n; ++i) {
+            legacy[i].name = names[i];
+            legacy[i].status = ThumbStatus(i % 3);
+        }
+        int64 legacy_kb = MemoryUsedKb() - mem0;
+
+        mem0 = MemoryUsedKb();
+        GalleryItemStore store;
+        store.Reserve(n);
+        for(int i = 0; i < n; ++i) {
+            store.Add(names[i], Color(i, i >> 8, i >> 16));
+            store.SetStatus(i, ThumbStatus(i % 3));
+        }
+        int64 store_kb = MemoryUsedKb() - mem0;
+
+        int hits = 0;
+        int64 t_legacy = BenchBest(5, [&] {
+            hits = 0;
+            for(const LegacyItem& it : legacy)
+                hits += it.status == ThumbStatus::Missing && !it.thumb_queued;
+        });
+        int64 t_store = BenchBest(5, [&] {
+            hits = 0;
+            for(int i = 0; i < n; ++i)
+                hits += store.GetStatus(i) == ThumbStatus::Missing && !store.IsQueued(i);
+        });
+
+        Cout() << Format("store %7d items: legacy %5.1f B/item (%d KB), columnar %5.1f B/item (%d KB, %d payloads)\n",
+                         n, 1024.0 * legacy_kb / n, legacy_kb, double(store.GetMemory()) / n, store_kb,
+                         store.GetPayloadCount());
+        Cout() << Format("store %7d items: status scan legacy %.2f ms (%.0f Mitems/s), columnar %.2f ms (%.0f Mitems/s), %d hits\n",
+                         n, t_legacy / 1000.0, double(n) / max<int64>(t_legacy, 1),
+                         t_store / 1000.0, double(n) / max<int64>(t_store, 1), hits);
+    }
+}
@@ -0,0 +1,66 @@
+#include "GalleryBench.h"
+
+// 100k-record library (every 10th with a source and a 32 px thumb): open, first screen with
+// its thumbs faulted in from the mapping, an incremental save and compaction
+void BenchLibrary()
+{
+    const int N = 100000, SRC = 48, TILE = 32;
+    const Size VIEW(1280, 800);
+    String path = AppendFileName(GetTempPath(), "gallerybench.iglb");
+    DeleteFile(path);
+
+    {
+        Vector<GalleryLibraryRow> rows;
+        rows.SetCount(N);
+        CoPartition(0, N, [&](int a, int b) {
+            for(int i = a; i < b; ++i) {
+                GalleryLibraryRow& r = rows[i];
+                r.name = Format(i & 1 ? "glyph_%d_outline_rounded" : "icon%d", i);
+                r.seed = HsvColorf((i % 360) / 360.0, 0.5, 0.8);
+                r.tags = i % 7 ? String() : String("brand");
+                if(i % 10) continue;
+                Image m = BenchSource(Size(SRC, SRC), i);
+                r.src = PNGEncoder().SaveString(m);
+                r.thumbs.Add(ResampleThumb(m, TILE));
+            }
+        });
+        GalleryLibrary lib;
+        lib.Open(path);
+        int64 t0 = usecs();
+        lib.Save(rows);
+        Cout() << Format("library write %d records: %.1f ms, %d KB\n", N, (usecs() - t0) / 1000.0,
+                         int(lib.GetBytes() >> 10));
+    }
+
+    GalleryLibrary lib;
+    int64 t0 = usecs();
+    lib.Open(path);
+    int64 open_us = usecs() - t0;
+
+    IconGalleryCtrl g;
+    g.SetRect(Rect(VIEW));
+    g.SetZoomIndex(0); // 32 px: the stored thumbs are used as they are
+    t0 = usecs();
+    g.OpenLibrary(lib);
+    int64 items_us = usecs() - t0;
+    ImageDraw iw(VIEW);
+    PaintUntilIdle(g, iw);
+    int64 screen_us = usecs() - t0;
+    Cout() << Format("library open: map %.2f ms, items %.1f ms, first screen with thumbs %.1f ms\n",
+                     open_us / 1000.0, items_us / 1000.0, screen_us / 1000.0);
+
+    for(int i = 0; i < 100; ++i) // a few edits, then an incremental save
+        g.SetThumbImage(i * 10, GalleryTileAtlas::Build(ThumbStatus::Missing, SRC, false));
+    int64 before = lib.GetBytes();
+    t0 = usecs();
+    bool saved = g.SaveLibrary(lib);
+    Cout() << Format("library save after 100 edits: %.1f ms, file +%d KB of %d KB%s\n",
+                     (usecs() - t0) / 1000.0, int((lib.GetBytes() - before) >> 10),
+                     int(lib.GetBytes() >> 10), saved ? "" : ", SAVE FAILED");
+
+    int64 live = lib.GetLiveBytes();
+    t0 = usecs();
+    bool compacted = lib.Compact();
+    Cout() << Format("library compact: %.1f ms, %d KB live, now %d KB%s\n", (usecs() - t0) / 1000.0,
+                     int(live >> 10), int(lib.GetBytes() >> 10), compacted ? "" : ", COMPACT FAILED");
+}
@@ -0,0 +1,34 @@
+#include "GalleryBench.h"
+
+// Scroll through every item at 128 px, unbounded against a 32 MB thumbnail budget: heap
+// growth, measured thumbnail bytes and evictions, then the same again after scrolling back
+void BenchMemory()
+{
+    const int N = 5000, SRC = 32;
+    const Size VIEW(1280, 800);
+    for(int64 budget : { (int64)0, (int64)32 << 20 }) {
+        int64 kb0 = MemoryUsedKb();
+        IconGalleryCtrl g;
+        g.SetThumbBudget(budget);
+        Vector<String> names;
+        Vector<Image>  imgs;
+        for(int i = 0; i < N; ++i) {
+            names.Add(Format("icon %d", i));
+            imgs.Add(BenchSource(Size(SRC, SRC), i));
+        }
+        g.AddRange(names, imgs);
+        g.SetRect(Rect(VIEW));
+        g.SetZoomIndex(g.GetZoomCount() - 1);
+        ImageDraw iw(VIEW);
+        int64 peak = 0, t0 = usecs();
+        for(int pass = 0; pass < 2; ++pass)
+            for(int y = 0; y < g.GetContentHeight(); y += VIEW.cy / 2) {
+                g.SetScrollY(pass ? g.GetContentHeight() - y : y);
+                PaintUntilIdle(g, iw);
+                peak = max(peak, (int64)MemoryUsedKb() - kb0);
+            }
+        Cout() << Format("memory %5d items, budget %3d MB: %.1f s, peak heap %7d KB, thumbs %7d KB, "
+                         "%d levels evicted\n", N, int(budget >> 20), (usecs() - t0) / 1e6, (int)peak,
+                         int(g.GetThumbBytes() >> 10), g.GetEvictedThumbs());
+    }
+}
@@ -0,0 +1,38 @@
+#include "GalleryBench.h"
+
+static Image Noise(Size sz)
+{
+    ImageBuffer ib(sz);
+    dword seed = 1;
+    RGBA *c = ib.Begin();
+    for(int i = 0; i < sz.cx * sz.cy; ++i, ++c) {
+        seed = seed * 1664525 + 1013904223;
+        c->a = 255;
+        c->r = byte(seed >> 8);
+        c->g = byte(seed >> 16);
+        c->b = byte(seed >> 24);
+    }
+    return ib;
+}
+
+// Source megapixels per second into every zoom step, U++ Rescale (what EnsureThumbs used)
+// against ResampleThumb in both qualities
+void BenchResample()
+{
+    for(Size ssz : { Size(256, 256), Size(1024, 1024), Size(3000, 2000), Size(4096, 4096) }) {
+        Image m = Noise(ssz);
+        double mpx = ssz.cx * ssz.cy / 1e6;
+        const int reps = max(1, int(8 / mpx)); // ~8 Mpx per run
+        for(int tile = 32; tile <= 128; tile += 16) {
+            auto rate = [&](int64 us) { return reps * mpx * 1e6 / max<int64>(us, 1); };
+            int64 rescale = BenchBest(3, [&] { for(int i = 0; i < reps; ++i) Rescale(m, Size(tile, tile)); });
+            int64 best    = BenchBest(3, [&] { for(int i = 0; i < reps; ++i) ResampleThumb(m, tile); });
+            int64 fast    = BenchBest(3, [&] { for(int i = 0; i < reps; ++i)
+                                                   ResampleThumb(m, tile, ThumbFit::Fit, ResampleQuality::Fast); });
+            Cout() << Format("resample %4dx%-4d -> %3d: Rescale %8.1f Mpx/s, Lanczos %8.1f Mpx/s (x%.1f), "
+                             "box %8.1f Mpx/s (x%.1f)\n", ssz.cx, ssz.cy, tile,
+                             rate(rescale), rate(best), double(rescale) / max<int64>(best, 1),
+                             rate(fast), double(rescale) / max<int64>(fast, 1));
+        }
+    }
+}
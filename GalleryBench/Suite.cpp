@@ -0,0 +1,201 @@
+#include "GalleryBench.h"
+
+#ifdef PLATFORM_POSIX
+#include <sys/resource.h>
+#endif
+#ifdef PLATFORM_WIN32
+#include <psapi.h>
+#endif
+
+// Headless IconGalleryCtrl suite: the control is painted into an ImageDraw and every
+// measurement is printed as one JSON object per line, so runs can be diffed across commits.
+
+static int64 PeakRssKb()
+{
+#ifdef PLATFORM_WIN32
+    PROCESS_MEMORY_COUNTERS pmc;
+    GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+    return pmc.PeakWorkingSetSize >> 10;
+#else
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef PLATFORM_OSX
+    return ru.ru_maxrss >> 10; // bytes there
+#else
+    return ru.ru_maxrss;
+#endif
+#endif
+}
+
+// Live heap blocks. The difference over a phase is allocations minus frees: the heap keeps no
+// running allocation count, so blocks allocated and freed within the phase do not show.
+static int64 HeapBlocks()
+{
+    MemoryProfile p;
+    int64 n = p.large_count + p.big_count;
+    for(int i = 0; i < __countof(p.allocated); ++i)
+        n += p.allocated[i];
+    return n;
+}
+
+struct SuiteProbe {
+    String        bench;
+    int           items;
+    Vector<int64> us;
+    int64         blocks0, kb0;
+    Json          extra;
+
+    template <class F>
+    void Sample(F fn) {
+        int64 t0 = usecs();
+        fn();
+        us.Add(usecs() - t0);
+    }
+
+    SuiteProbe(const char *bench, int items) : bench(bench), items(items) {
+        blocks0 = HeapBlocks();
+        kb0 = MemoryUsedKb();
+    }
+
+    ~SuiteProbe() {
+        Sort(us);
+        auto pct = [&](double q) { return us.GetCount() ? us[min(us.GetCount() - 1, int(q * us.GetCount()))] : 0; };
+        int64 total = 0;
+        for(int64 t : us) total += t;
+        Json j;
+        j("bench", bench)("items", items)("samples", us.GetCount())("total_us", total)
+         ("p50_us", pct(0.5))("p90_us", pct(0.9))("p99_us", pct(0.99))
+         ("max_us", us.GetCount() ? us.Top() : 0)
+         ("heap_net_blocks", HeapBlocks() - blocks0)("heap_kb", MemoryUsedKb() - kb0)
+         ("peak_rss_kb", PeakRssKb());
+        String s = j.ToString();
+        String x = extra.ToString();
+        if(x.GetCount() > 2) // merge the extra fields into the same object
+            s = s.Mid(0, s.GetCount() - 1) + ',' + x.Mid(1);
+        Cout() << s << '\n';
+    }
+};
+
+static const Size VIEW(1280, 800);
+
+static void PaintFrame(IconGalleryCtrl& g, ImageDraw& iw)
+{
+    Ctrl& c = g; // Paint is public on Ctrl
+    c.Paint(iw);
+}
+
+static void SuiteSize(int n)
+{
+    Vector<String> names;
+    names.Reserve(n);
+    for(int i = 0; i < n; ++i)
+        names.Add(Format(i & 1 ? "glyph_%d_outline_rounded" : "icon%d", i));
+
+    {
+        IconGalleryCtrl g;
+        SuiteProbe p("add_range", n);
+        p.Sample([&] { g.AddRange(names); });
+    }
+    {
+        IconGalleryCtrl g;
+        SuiteProbe p("add_1k", n); // per 1000 single Adds, batched
+        g.BeginUpdate();
+        for(int i = 0; i < n; i += 1000)
+            p.Sample([&] {
+                for(int k = i; k < min(n, i + 1000); ++k)
+                    g.Add(names[k]);
+            });
+        g.EndUpdate();
+    }
+
+    IconGalleryCtrl g;
+    g.AddRange(names);
+    g.SetRect(Rect(VIEW));
+    Ctrl& c = g;
+    {
+        SuiteProbe p("reflow", n);
+        for(int k = 0; k < 20; ++k)
+            p.Sample([&] { c.Layout(); });
+    }
+
+    ImageDraw iw(VIEW);
+    for(int zi = 0; zi < g.GetZoomCount(); ++zi) {
+        g.SetZoomIndex(zi);
+        g.SetScrollY(0);
+        SuiteProbe p("paint", n);
+        p.extra("tile", g.GetTileSize(zi));
+        int64 t0 = usecs();
+        PaintFrame(g, iw);
+        p.extra("cold_us", usecs() - t0);
+        for(int k = 0; k < 30; ++k)
+            p.Sample([&] { PaintFrame(g, iw); });
+    }
+
+    g.SetZoomIndex(2);
+    for(int pass = 0; pass < 2; ++pass) { // first sweep builds the tile cache, second is warm
+        SuiteProbe p(pass ? "scroll_warm" : "scroll_cold", n);
+        int step = max(VIEW.cy / 4, g.GetContentHeight() / 2000);
+        for(int y = 0; y < g.GetContentHeight(); y += step)
+            p.Sample([&] { g.SetScrollY(y); PaintFrame(g, iw); });
+    }
+
+    {
+        SuiteProbe p("hit_test_100k", n);
+        dword seed = 1;
+        p.Sample([&] {
+            int hits = 0;
+            for(int k = 0; k < 100000; ++k) {
+                seed = seed * 1664525 + 1013904223;
+                hits += g.GetIndexAt(Point(seed % VIEW.cx, (seed >> 12) % VIEW.cy)) >= 0;
+            }
+            p.extra("hits", hits);
+        });
+    }
+    {
+        SuiteProbe p("items_in_rect_1k", n);
+        p.Sample([&] {
+            for(int k = 0; k < 1000; ++k)
+                g.GetItemsInRect(Rect(VIEW).Deflated(k % 200));
+        });
+    }
+
+    { SuiteProbe p("select_all", n); p.Sample([&] { g.SelectAll(); }); }
+    { SuiteProbe p("invert", n);     p.Sample([&] { g.InvertSelection(); }); }
+    { SuiteProbe p("clear", n);      p.Sample([&] { g.ClearSelection(); }); }
+    for(int i = 0; i < n; i += 10)
+        g.Select(i);
+    { SuiteProbe p("remove_10pct", n); p.Sample([&] { g.RemoveSelected(); }); }
+}
+
+// Worker pipeline end to end: every page is scrolled to and pumped until its thumbs are in
+static void SuiteThumbs(int n)
+{
+    Vector<Image> src;
+    for(int k = 0; k < 8; ++k)
+        src.Add(BenchSource(Size(256, 256), 32 * k));
+    Vector<String> names;
+    Vector<Image> imgs;
+    for(int i = 0; i < n; ++i) {
+        names.Add(Format("thumb%d", i));
+        imgs.Add(src[i % src.GetCount()]);
+    }
+
+    IconGalleryCtrl g;
+    g.AddRange(names, imgs);
+    g.SetRect(Rect(VIEW));
+    g.SetSaturationOn(false); // gray variants too
+    ImageDraw iw(VIEW);
+    SuiteProbe p("thumbs_page", n);
+    for(int y = 0; y < g.GetContentHeight(); y += VIEW.cy)
+        p.Sample([&] {
+            g.SetScrollY(y);
+            PaintUntilIdle(g, iw);
+        });
+}
+
+void BenchSuite()
+{
+    for(int n : { 10000, 100000, 1000000 })
+        SuiteSize(n);
+    SuiteThumbs(2000);
+}
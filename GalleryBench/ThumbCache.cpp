@@ -0,0 +1,37 @@
+#include "GalleryBench.h"
+
+// Cold (decode + rescale + pack write) vs warm (mapped pre-scaled thumbs) SetThumbFromFile
+void BenchThumbCache()
+{
+    const int N = 1000, SRC = 512;
+    String dir = AppendFileName(GetTempPath(), "gallerybench_src");
+    RealizeDirectory(dir);
+    Vector<String> files, names;
+    for(int i = 0; i < N; ++i) {
+        String fn = AppendFileName(dir, Format("icon%04d.png", i));
+        if(!FileExists(fn))
+            PNGEncoder().SaveFile(fn, BenchSource(Size(SRC, SRC), i));
+        files.Add(fn);
+        names.Add(GetFileTitle(fn));
+    }
+
+    String pack = AppendFileName(GetTempPath(), "gallerybench.igtc");
+    DeleteFile(pack);
+
+    auto run = [&](const char *label) {
+        ThumbDiskCache cache;
+        cache.Open(pack);
+        IconGalleryCtrl g;
+        g.SetDiskCache(&cache);
+        int64 mem0 = MemoryUsedKb();
+        int64 t0 = usecs();
+        g.AddRange(names);
+        for(int i = 0; i < N; ++i)
+            g.SetThumbFromFile(i, files[i]);
+        int64 t = usecs() - t0;
+        Cout() << Format("cache %s: %d files in %.1f ms (%.1f us/file), +%d KB resident, hits %d\n",
+                         label, N, t / 1000.0, double(t) / N, MemoryUsedKb() - mem0, cache.GetHits());
+    };
+    run("cold");
+    run("warm");
+}
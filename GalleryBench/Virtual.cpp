@@ -0,0 +1,68 @@
+#include "GalleryBench.h"
+
+// A glyph-font sized source with no storage of its own: every fourth entry has a thumbnail,
+// drawn on request
+struct BenchProvider : GalleryProvider {
+    int count;
+
+    BenchProvider(int n) : count(n) {}
+
+    int    GetCount() const override             { return count; }
+    String GetName(int i) const override         { return Format("glyph U+%05X", i); }
+    bool   HasThumb(int i) const override        { return (i & 3) == 0; }
+    Image  GetThumb(int i, int tile) const override {
+        int n = tile ? tile : 128;
+        return BenchSource(Size(n, n), i);
+    }
+};
+
+// Virtual mode against stored items of the same count: time to open, memory after opening
+// and after a scroll through the whole range, with the cached row count staying flat
+void BenchVirtual()
+{
+    const Size VIEW(1280, 800);
+    for(int n : { 100000, 1000000 }) {
+        int64 kb0 = MemoryUsedKb();
+        int64 t0 = usecs();
+        {
+            IconGalleryCtrl g;
+            Vector<String> names;
+            names.Reserve(n);
+            for(int i = 0; i < n; ++i)
+                names.Add(Format("glyph U+%05X", i));
+            g.AddRange(names);
+            Cout() << Format("virtual %7d stored:  open %7.1f ms, %6d KB\n", n, (usecs() - t0) / 1000.0,
+                             int(MemoryUsedKb() - kb0));
+        }
+
+        BenchProvider provider(n);
+        IconGalleryCtrl g;
+        g.SetRect(Rect(VIEW));
+        kb0 = MemoryUsedKb();
+        t0 = usecs();
+        g.SetProvider(&provider);
+        int64 open_us = usecs() - t0;
+        int64 open_kb = MemoryUsedKb() - kb0;
+
+        ImageDraw iw(VIEW);
+        Ctrl& c = g;
+        Vector<int64> us;
+        int max_rows = 0;
+        int step = max(VIEW.cy, g.GetContentHeight() / 200);
+        for(int y = 0; y < g.GetContentHeight(); y += step) {
+            g.SetScrollY(y);
+            int64 t = usecs();
+            c.Paint(iw);
+            us.Add(usecs() - t);
+            PaintUntilIdle(g, iw);
+            max_rows = max(max_rows, g.GetCachedItemCount());
+        }
+        Sort(us);
+        g.SelectAll();
+        Cout() << Format("virtual %7d virtual: open %7.2f ms, %6d KB; scroll %d frames p50 %d us p99 %d us, "
+                         "%d KB after, at most %d rows cached, %d selected\n",
+                         n, open_us / 1000.0, int(open_kb), us.GetCount(), (int)us[us.GetCount() / 2],
+                         (int)us[min(us.GetCount() - 1, us.GetCount() * 99 / 100)],
+                         int(MemoryUsedKb() - kb0), max_rows, g.GetSelectionCount());
+    }
+}
@@ -0,0 +1,29 @@
+#include "GalleryBench.h"
+
+// Runs without opening a window; pass benchmark names to select a subset.
+GUI_APP_MAIN
+{
+    const Vector<String>& cmd = CommandLine();
+    auto want = [&](const char *name) { return cmd.IsEmpty() || FindIndex(cmd, name) >= 0; };
+
+    if(want("gray"))
+        BenchGrayKernel();
+    if(want("cache"))
+        BenchThumbCache();
+    if(want("store"))
+        BenchItemStore();
+    if(want("suite"))
+        BenchSuite(); // JSON lines
+    if(want("export"))
+        BenchExport();
+    if(want("atlas"))
+        BenchAtlas(); // includes the index round trip through SetThumbImage, exit code 1 on a mismatch
+    if(want("library"))
+        BenchLibrary();
+    if(want("virtual"))
+        BenchVirtual();
+    if(want("resample"))
+        BenchResample();
+    if(want("memory"))
+        BenchMemory();
+}
@@ -0,0 +1,126 @@
+#include "IconGalleryCtrl.h"
+
+#ifdef CPU_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Luma weights 77/151/28 (sum 256) approximate the classic 30/59/11 split with a shift
+// instead of a division. Images are premultiplied; luma of premultiplied channels stays
+// premultiplied, so alpha is simply carried over.
+enum { LUMA_R = 77, LUMA_G = 151, LUMA_B = 28 };
+
+static inline int Luma(const RGBA& c) { return (c.r * LUMA_R + c.g * LUMA_G + c.b * LUMA_B) >> 8; }
+
+static void DesaturateScalar(RGBA*& t, const RGBA*& s, int& n, int amount) {
+    int keep = 256 - amount;
+    for(; n > 0; --n, ++s, ++t) {
+        int l = Luma(*s) * amount;
+        t->r = (byte)((s->r * keep + l) >> 8);
+        t->g = (byte)((s->g * keep + l) >> 8);
+        t->b = (byte)((s->b * keep + l) >> 8);
+        t->a = s->a;
+    }
+}
+
+// RGBA channel order differs between platforms, so weights and the alpha mask are placed
+// by member offset rather than hardcoded.
+static void LumaWeights(int16 *w) {
+    w[offsetof(RGBA, r)] = LUMA_R;
+    w[offsetof(RGBA, g)] = LUMA_G;
+    w[offsetof(RGBA, b)] = LUMA_B;
+    w[offsetof(RGBA, a)] = 0;
+}
+
+static inline int AlphaMask() { return (int)(0xffu << (8 * offsetof(RGBA, a))); }
+
+#ifdef CPU_SSE2
+static void DesaturateSSE2(RGBA*& t, const RGBA*& s, int& n, int amount) {
+    int16 w[4];
+    LumaWeights(w);
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i wts   = _mm_setr_epi16(w[0], w[1], w[2], w[3], w[0], w[1], w[2], w[3]);
+    const __m128i amask = _mm_set1_epi32(AlphaMask());
+    const __m128i keep  = _mm_set1_epi16(256 - amount);
+    const __m128i mix   = _mm_set1_epi16(amount);
+    for(; n >= 4; n -= 4, s += 4, t += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)s);
+        __m128i lo = _mm_unpacklo_epi8(px, zero);             // pixels 0,1 as 16-bit
+        __m128i hi = _mm_unpackhi_epi8(px, zero);             // pixels 2,3
+        __m128i ml = _mm_madd_epi16(lo, wts);                 // two partial sums per pixel
+        __m128i mh = _mm_madd_epi16(hi, wts);
+        ml = _mm_add_epi32(ml, _mm_srli_epi64(ml, 32));
+        mh = _mm_add_epi32(mh, _mm_srli_epi64(mh, 32));
+        __m128i l = _mm_unpacklo_epi64(_mm_shuffle_epi32(ml, _MM_SHUFFLE(3, 3, 2, 0)),
+                                       _mm_shuffle_epi32(mh, _MM_SHUFFLE(3, 3, 2, 0)));
+        l = _mm_srli_epi32(l, 8);
+        l = _mm_or_si128(l, _mm_slli_epi32(l, 8));
+        l = _mm_or_si128(l, _mm_slli_epi32(l, 16));           // luma in every byte
+        __m128i g = _mm_or_si128(_mm_andnot_si128(amask, l), _mm_and_si128(amask, px));
+        if(amount < 256) {
+            __m128i glo = _mm_unpacklo_epi8(g, zero), ghi = _mm_unpackhi_epi8(g, zero);
+            lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, keep), _mm_mullo_epi16(glo, mix)), 8);
+            hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, keep), _mm_mullo_epi16(ghi, mix)), 8);
+            g = _mm_packus_epi16(lo, hi);
+        }
+        _mm_storeu_si128((__m128i *)t, g);
+    }
+}
+#endif
+
+#ifdef __AVX2__
+// Same dataflow as the SSE2 path; AVX2 unpack/shuffle work per 128-bit lane, which keeps
+// the pixel order intact.
+static void DesaturateAVX2(RGBA*& t, const RGBA*& s, int& n, int amount) {
+    int16 w[4];
+    LumaWeights(w);
+    const __m256i zero  = _mm256_setzero_si256();
+    const __m256i wts   = _mm256_setr_epi16(w[0], w[1], w[2], w[3], w[0], w[1], w[2], w[3],
+                                            w[0], w[1], w[2], w[3], w[0], w[1], w[2], w[3]);
+    const __m256i amask = _mm256_set1_epi32(AlphaMask());
+    const __m256i keep  = _mm256_set1_epi16(256 - amount);
+    const __m256i mix   = _mm256_set1_epi16(amount);
+    for(; n >= 8; n -= 8, s += 8, t += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i *)s);
+        __m256i lo = _mm256_unpacklo_epi8(px, zero);
+        __m256i hi = _mm256_unpackhi_epi8(px, zero);
+        __m256i ml = _mm256_madd_epi16(lo, wts);
+        __m256i mh = _mm256_madd_epi16(hi, wts);
+        ml = _mm256_add_epi32(ml, _mm256_srli_epi64(ml, 32));
+        mh = _mm256_add_epi32(mh, _mm256_srli_epi64(mh, 32));
+        __m256i l = _mm256_unpacklo_epi64(_mm256_shuffle_epi32(ml, _MM_SHUFFLE(3, 3, 2, 0)),
+                                          _mm256_shuffle_epi32(mh, _MM_SHUFFLE(3, 3, 2, 0)));
+        l = _mm256_srli_epi32(l, 8);
+        l = _mm256_or_si256(l, _mm256_slli_epi32(l, 8));
+        l = _mm256_or_si256(l, _mm256_slli_epi32(l, 16));
+        __m256i g = _mm256_or_si256(_mm256_andnot_si256(amask, l), _mm256_and_si256(amask, px));
+        if(amount < 256) {
+            __m256i glo = _mm256_unpacklo_epi8(g, zero), ghi = _mm256_unpackhi_epi8(g, zero);
+            lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(lo, keep), _mm256_mullo_epi16(glo, mix)), 8);
+            hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(hi, keep), _mm256_mullo_epi16(ghi, mix)), 8);
+            g = _mm256_packus_epi16(lo, hi);
+        }
+        _mm256_storeu_si256((__m256i *)t, g);
+    }
+}
+#endif
+
+void DesaturateRGBA(RGBA *t, const RGBA *s, int count, int amount) {
+    amount = minmax(amount, 0, 256);
+#ifdef __AVX2__
+    DesaturateAVX2(t, s, count, amount);
+#endif
+#ifdef CPU_SSE2
+    DesaturateSSE2(t, s, count, amount);
+#endif
+    DesaturateScalar(t, s, count, amount); // tail (or everything without SIMD)
+}
+
+Image DesaturateImage(const Image& m, int amount) {
+    ImageBuffer ib(m.GetSize());
+    DesaturateRGBA(ib.Begin(), m.Begin(), (int)m.GetLength(), amount);
+    ib.SetKind(m.GetKind());
+    return ib;
+}
@@ -0,0 +1,172 @@
+#include "IconGalleryCtrl.h"
+#include <plugin/png/png.h>
+
+// Sprite sheets: one packed PNG per output size with a JSON and a binary name -> rect index
+
+static const char sAtlasMagic[4] = { 'I', 'G', 'A', 'T' };
+enum { ATLAS_VERSION = 1 };
+
+// ---------------- Packing ----------------
+Size GalleryShelfPack(const Vector<Size>& rects, Vector<Rect>& out, int pad)
+{
+    out.SetCount(rects.GetCount());
+    if(rects.IsEmpty())
+        return Size(0, 0);
+    int64 area = 0;
+    int widest = 0;
+    for(Size sz : rects) {
+        area += int64(sz.cx + 2 * pad) * (sz.cy + 2 * pad);
+        widest = max(widest, sz.cx + 2 * pad);
+    }
+    int width = max(widest, (int)ceil(sqrt((double)area)));
+
+    Vector<int> order;
+    for(int i = 0; i < rects.GetCount(); ++i) order.Add(i);
+    StableSort(order, [&](int a, int b) { return rects[a].cy > rects[b].cy; });
+
+    int x = 0, y = 0, shelf = 0, used = 0;
+    for(int i : order) {
+        Size sz = rects[i] + Size(2 * pad, 2 * pad);
+        if(x + sz.cx > width) { // next shelf
+            y += shelf;
+            x = shelf = 0;
+        }
+        out[i] = RectC(x + pad, y + pad, rects[i].cx, rects[i].cy);
+        x += sz.cx;
+        shelf = max(shelf, sz.cy);
+        used = max(used, x);
+    }
+    return Size(used, y + shelf);
+}
+
+// ---------------- Index ----------------
+String GalleryAtlasIndex::ToJson() const
+{
+    JsonArray a;
+    for(const GalleryAtlasEntry& e : entry)
+        a << Json("name", e.name)("x", e.rect.left)("y", e.rect.top)("w", e.rect.Width())("h", e.rect.Height());
+    return Json("size", px)("image", image)("width", size.cx)("height", size.cy)("icons", a).ToString();
+}
+
+bool GalleryAtlasIndex::LoadJson(const String& s)
+{
+    Value v = ParseJSON(s);
+    if(IsError(v) || !IsValueMap(v))
+        return false;
+    px = (int)v["size"];
+    image = (String)v["image"];
+    size = Size((int)v["width"], (int)v["height"]);
+    const Value& icons = v["icons"];
+    entry.Clear();
+    for(int i = 0; i < icons.GetCount(); ++i) {
+        const Value& q = icons[i];
+        GalleryAtlasEntry& e = entry.Add();
+        e.name = (String)q["name"];
+        e.rect = RectC((int)q["x"], (int)q["y"], (int)q["w"], (int)q["h"]);
+    }
+    return true;
+}
+
+String GalleryAtlasIndex::ToBinary() const
+{
+    StringStream ss;
+    ss.Put(sAtlasMagic, 4);
+    ss.Put32le(ATLAS_VERSION);
+    ss.Put32le(px);
+    ss.Put32le(size.cx);
+    ss.Put32le(size.cy);
+    ss.Put32le(entry.GetCount());
+    for(const GalleryAtlasEntry& e : entry) {
+        ss.Put32le(e.rect.left);
+        ss.Put32le(e.rect.top);
+        ss.Put32le(e.rect.Width());
+        ss.Put32le(e.rect.Height());
+        ss.Put32le(e.name.GetCount());
+        ss.Put(e.name);
+    }
+    return ss.GetResult();
+}
+
+bool GalleryAtlasIndex::LoadBinary(const String& s)
+{
+    StringStream ss(s);
+    char magic[4];
+    if(!ss.GetAll(magic, 4) || memcmp(magic, sAtlasMagic, 4) || ss.Get32le() != ATLAS_VERSION)
+        return false;
+    px = ss.Get32le();
+    size.cx = ss.Get32le();
+    size.cy = ss.Get32le();
+    int n = ss.Get32le();
+    if(n < 0 || n > s.GetCount() / 20)
+        return false;
+    entry.Clear();
+    entry.Reserve(n);
+    for(int i = 0; i < n; ++i) {
+        GalleryAtlasEntry& e = entry.Add();
+        int x = ss.Get32le(), y = ss.Get32le(), cx = ss.Get32le(), cy = ss.Get32le();
+        e.rect = RectC(x, y, cx, cy);
+        int len = ss.Get32le();
+        if(len < 0 || len > ss.GetLeft())
+            return false;
+        e.name = ss.Get(len);
+    }
+    return !ss.IsError();
+}
+
+// ---------------- Export ----------------
+bool GalleryExportAtlas(const Vector<GalleryExportItem>& items, const Vector<int>& sizes,
+                        const String& dir, const String& title)
+{
+    if(items.IsEmpty() || sizes.IsEmpty() || !RealizeDirectory(dir))
+        return false;
+    int n = items.GetCount(), ns = sizes.GetCount();
+
+    Array<GalleryAtlasIndex> index;
+    Array<ImageBuffer>       sheet;
+    for(int px : sizes) {
+        Vector<Size> rs;
+        rs.SetCount(n, Size(px, px));
+        Vector<Rect> rc;
+        GalleryAtlasIndex& x = index.Add();
+        x.px = px;
+        x.image = Format("%s_%d.png", title, px);
+        x.size = GalleryShelfPack(rs, rc);
+        x.entry.SetCount(n);
+        for(int i = 0; i < n; ++i) {
+            x.entry[i].name = items[i].name;
+            x.entry[i].rect = rc[i];
+        }
+        ImageBuffer& ib = sheet.Add();
+        ib.Create(x.size);
+        Fill(ib.Begin(), RGBAZero(), ib.GetLength());
+    }
+
+    // The rects never overlap, so the workers draw into the shared sheets without locking
+    CoPartition(0, n, [&](int a, int b) {
+        for(int i = a; i < b; ++i) {
+            const GalleryExportItem& e = items[i];
+            Image src = GalleryExporter::Decode(e);
+            for(int s = 0; s < ns; ++s) {
+                Image m = GalleryExporter::Render(e, src, index[s].px);
+                Rect r = index[s].entry[i].rect;
+                for(int y = 0; y < r.Height(); ++y)
+                    memcpy(sheet[s][r.top + y] + r.left, m[y], r.Width() * sizeof(RGBA));
+            }
+        }
+    });
+
+    std::atomic<bool> ok(true);
+    CoWork co;
+    for(int s = 0; s < ns; ++s)
+        co & [&, s] {
+            const GalleryAtlasIndex& x = index[s];
+            String base = AppendFileName(dir, GetFileTitle(x.image));
+            Image img = sheet[s];
+            if(!PNGEncoder().SaveFile(AppendFileName(dir, x.image), img) ||
+               !SaveFile(base + ".json", x.ToJson()) ||
+               !SaveFile(base + ".igat", x.ToBinary()))
+                ok = false;
+        };
+    co.Finish();
+    return ok;
+}
@@ -0,0 +1,108 @@
+#include "IconGalleryCtrl.h"
+
+static inline int Popcount64(uint64 x)
+{
+#ifdef COMPILER_MSC
+    return (int)__popcnt64(x);
+#else
+    return __builtin_popcountll(x);
+#endif
+}
+
+// Mask of bits [lo, hi) inside one word, 0 <= lo < hi <= 64
+static inline uint64 WordMask(int lo, int hi)
+{
+    uint64 m = hi == 64 ? ~(uint64)0 : ((uint64)1 << hi) - 1;
+    return m & ~(((uint64)1 << lo) - 1);
+}
+
+void GalleryBits::TrimTail()
+{
+    if(count & 63)
+        w.Top() &= WordMask(0, count & 63);
+}
+
+void GalleryBits::Recount()
+{
+    ones = 0;
+    for(uint64 x : w) ones += Popcount64(x);
+}
+
+void GalleryBits::SetCount(int n)
+{
+    bool shrink = n < count;
+    w.SetCount((n + 63) >> 6, 0);
+    count = n;
+    if(shrink) {
+        TrimTail();
+        Recount();
+    }
+}
+
+void GalleryBits::Set(int i, bool b)
+{
+    ASSERT(i >= 0 && i < count);
+    uint64& x = w[i >> 6];
+    uint64  m = (uint64)1 << (i & 63);
+    if(!!(x & m) == b) return;
+    x ^= m;
+    ones += b ? 1 : -1;
+}
+
+// [a, b) to v: head and tail words are masked, whole words in between are stored directly
+void GalleryBits::SetRange(int a, int b, bool v)
+{
+    a = max(a, 0);
+    b = min(b, count);
+    while(a < b) {
+        int wi = a >> 6;
+        int hi = min(b - (wi << 6), 64);
+        uint64 m = WordMask(a & 63, hi);
+        uint64& x = w[wi];
+        ones -= Popcount64(x & m);
+        if(v) { x |= m; ones += Popcount64(m); }
+        else  x &= ~m;
+        a = (wi << 6) + hi;
+    }
+}
+
+void GalleryBits::Invert()
+{
+    for(uint64& x : w) x = ~x;
+    TrimTail();
+    ones = count - ones;
+}
+
+void GalleryBits::Zero()
+{
+    for(uint64& x : w) x = 0;
+    ones = 0;
+}
+
+int GalleryBits::FindNext(int i) const
+{
+    if(i < 0) i = 0;
+    if(i >= count) return -1;
+    int wi = i >> 6;
+    uint64 x = w[wi] & ~(((uint64)1 << (i & 63)) - 1);
+    for(;;) {
+        if(x) return (wi << 6) + GalleryCtz64(x);
+        if(++wi >= w.GetCount()) return -1;
+        x = w[wi];
+    }
+}
+
+// Drops every position marked in 'drop' and closes the gaps (mirrors item removal)
+void GalleryBits::Remove(const GalleryBits& drop)
+{
+    int j = 0;
+    for(int i = 0; i < count; ++i)
+        if(!drop[i]) {
+            uint64 m = (uint64)1 << (j & 63);
+            uint64& x = w[j >> 6];
+            x = (*this)[i] ? x | m : x & ~m;
+            j++;
+        }
+    SetCount(j);
+    Recount();
+}
@@ -0,0 +1,52 @@
+#include "IconGalleryCtrl.h"
+
+// Composited tiles: Paint blits a ready tile as one image. A composite is rebuilt only when
+// the item's revision, the zoom level, its variant bits or the theme change.
+
+// Longest prefix of name that fits cx together with the ellipsis
+String IconGalleryCtrl::FitCaption(const String& name, int cx, Font font)
+{
+    if(GetTextSize(name, font).cx <= cx)
+        return name;
+    WString w = name.ToWString();
+    int dots = GetTextSize("...", font).cx;
+    int lo = 0, hi = w.GetCount() - 1;
+    while(lo < hi) {
+        int m = (lo + hi + 1) / 2;
+        if(GetTextSize(w.Left(m), font).cx + dots <= cx) lo = m;
+        else hi = m - 1;
+    }
+    return w.Left(lo).ToString() + "...";
+}
+
+GalleryTileComposite& IconGalleryCtrl::Composite(int i)
+{
+    GalleryTileComposite& c = composites.GetAdd(((int64)zoom_i << 32) | i);
+    if(c.rev != items.GetRev(i)) {
+        if(c.rev < 0) {
+            int tile = zoom_steps[zoom_i];
+            c.caption = FitCaption(items.GetName(i), tile + 2*pad - 2*CAPTION_MARGIN, StdFont());
+        }
+        c.rev = items.GetRev(i);
+        for(Image& m : c.variant) m.Clear();
+    }
+    return c;
+}
+
+// Keeps the most recently painted entries; a few screens' worth covers scrolling back and forth
+void IconGalleryCtrl::TrimComposites(int keep)
+{
+    keep = max(keep, 256);
+    if(composites.GetCount() <= 2 * keep)
+        return;
+    Vector<int> stamp;
+    stamp.SetCount(composites.GetCount());
+    for(int i = 0; i < composites.GetCount(); ++i)
+        stamp[i] = composites[i].stamp;
+    std::nth_element(stamp.begin(), stamp.begin() + stamp.GetCount() - keep, stamp.end());
+    int cutoff = stamp[stamp.GetCount() - keep];
+    for(int i = 0; i < composites.GetCount(); ++i)
+        if(composites[i].stamp < cutoff)
+            composites.Unlink(i);
+    composites.Sweep();
+}
@@ -0,0 +1,146 @@
+#include "IconGalleryCtrl.h"
+#include <plugin/png/png.h>
+
+// Batch PNG export. The item list is copied up front, so the gallery may change or go away
+// while the workers run; sources are shared Images, and file-backed ones are decoded lazily.
+
+Vector<GalleryExportItem> GalleryExporter::Snapshot(const IconGalleryCtrl& g, const Vector<int>& items)
+{
+    Vector<GalleryExportItem> out;
+    out.Reserve(items.GetCount());
+    const GalleryProvider *vp = g.GetProvider();
+    for(int i : items) {
+        GalleryExportItem& e = out.Add();
+        if(vp) { // virtual: read the provider, as the row cache would pull in every item
+            e.name   = vp->GetName(i);
+            Color c  = vp->GetSeed(i);
+            e.seed   = IsNull(c) ? GalleryNameColor(e.name) : c;
+            e.status = vp->GetStatus(i);
+            if(vp->HasThumb(i)) { // fetched by the worker, so memory stays bounded
+                e.provider = vp;
+                e.index    = i;
+            }
+            continue;
+        }
+        IconGalleryItem it = g.GetItem(i);
+        e.name     = it.GetName();
+        e.src_path = it.GetSourcePath();
+        e.seed     = it.GetSeed();
+        e.status   = it.GetStatus();
+        if(it.GetLibRecord() >= 0 && it.GetLoadedSource().IsEmpty()) { // decoded by the worker
+            e.lib = it.GetLibrary();
+            e.rec = it.GetLibRecord();
+        }
+        else
+            e.src = it.GetLoadedSource();
+    }
+    return out;
+}
+
+Image GalleryExporter::Decode(const GalleryExportItem& e)
+{
+    if(!e.src.IsEmpty())
+        return e.src;
+    if(!IsNull(e.src_path))
+        return StreamRaster::LoadFileAny(e.src_path);
+    if(e.lib && e.rec >= 0)
+        return e.lib->GetSource(e.rec);
+    return e.provider ? e.provider->GetThumb(e.index, 0) : Image();
+}
+
+// The icon as the gallery would show it, at px x px, without the selection or filter chrome
+Image GalleryExporter::Render(const GalleryExportItem& it, const Image& decoded, int px)
+{
+    if(!decoded.IsEmpty())
+        return ResampleThumb(decoded, px);
+    ThumbStatus s = it.status;
+    if(s == ThumbStatus::Auto && it.HasImage())
+        s = ThumbStatus::Missing; // the source did not decode
+    return GalleryTileAtlas::Build(s, px, false, it.seed);
+}
+
+String GalleryExporter::FileTitle(const String& name)
+{
+    String r;
+    for(byte c : name) // bytes >= 0x80 are UTF-8 and pass through
+        r.Cat(c < ' ' || c == 0x7f || strchr("\\/:*?\"<>|", c) ? '_' : c);
+    r = TrimBoth(r);
+    return IsNull(r) || r == "." || r == ".." ? String("icon") : r;
+}
+
+bool GalleryExporter::Start(Vector<GalleryExportItem>&& items_, const Vector<int>& sizes_, const String& dir_, int nthreads)
+{
+    if(running || items_.IsEmpty() || sizes_.IsEmpty())
+        return false;
+    for(int px : sizes_)
+        if(!RealizeDirectory(AppendFileName(dir_, AsString(px))))
+            return false;
+
+    items = pick(items_);
+    sizes = clone(sizes_);
+    dir = dir_;
+
+    files.Clear();
+    Index<String> used; // "a", "a", "a" -> a, a (2), a (3)
+    for(const GalleryExportItem& e : items) {
+        String t = FileTitle(e.name), u = t;
+        for(int n = 2; used.Find(ToLower(u)) >= 0; ++n)
+            u = t + " (" + AsString(n) + ")";
+        used.Add(ToLower(u));
+        files.Add(u);
+    }
+
+    next = done = failed = 0;
+    cancel = false;
+    int n = clamp(nthreads > 0 ? nthreads : CPU_Cores(), 1, items.GetCount());
+    live = n;
+    running = true;
+    threads.Clear();
+    for(int i = 0; i < n; ++i)
+        threads.Add().Run([=] { Worker(); });
+    poll.Set(-100, [=] { Poll(); });
+    return true;
+}
+
+void GalleryExporter::Worker()
+{
+    for(;;) {
+        int i = next++;
+        if(cancel || i >= items.GetCount())
+            break;
+        const GalleryExportItem& e = items[i];
+        Image src = Decode(e);
+        if(src.IsEmpty() && e.HasImage()) { // unreadable source: failed, not a placeholder
+            failed += sizes.GetCount();
+            done += sizes.GetCount();
+            continue;
+        }
+        for(int px : sizes) {
+            if(cancel) break;
+            Image m = Render(e, src, px);
+            String fn = AppendFileName(AppendFileName(dir, AsString(px)), files[i] + ".png");
+            if(!PNGEncoder().SaveFile(fn, m))
+                failed++;
+            done++;
+        }
+    }
+    live--;
+}
+
+void GalleryExporter::Poll()
+{
+    WhenProgress(done, GetTotal());
+    if(live == 0) {
+        Wait();
+        WhenDone();
+    }
+}
+
+void GalleryExporter::Wait()
+{
+    for(Thread& t : threads)
+        t.Wait();
+    threads.Clear();
+    poll.Kill();
+    running = false;
+}
@@ -0,0 +1,157 @@
+#include "IconGalleryCtrl.h"
+
+static String SearchText(const String& name, const String& tags)
+{
+    return ToLower(IsNull(tags) ? name : name + ' ' + tags);
+}
+
+// Distinct byte trigrams of s, sorted
+void GalleryFilterIndex::Trigrams(const String& s, Vector<dword>& out)
+{
+    out.Clear();
+    const byte *p = (const byte *)~s;
+    for(int i = 0; i + 2 < s.GetCount(); ++i)
+        out.Add((p[i] << 16) | (p[i + 1] << 8) | p[i + 2]);
+    Sort(out);
+    int j = 0;
+    for(int i = 0; i < out.GetCount(); ++i)
+        if(j == 0 || out[j - 1] != out[i]) out[j++] = out[i];
+    out.SetCount(j);
+}
+
+void GalleryFilterIndex::Link(int i)
+{
+    Vector<dword> tri;
+    Trigrams(hay[i], tri);
+    for(dword t : tri) {
+        Vector<int>& list = postings.GetAdd(t);
+        if(list.GetCount() == 0 || list.Top() < i) list.Add(i); // the usual append
+        else list.Insert(int(std::lower_bound(list.begin(), list.end(), i) - list.begin()), i);
+    }
+}
+
+void GalleryFilterIndex::Unlink(int i)
+{
+    Vector<dword> tri;
+    Trigrams(hay[i], tri);
+    for(dword t : tri) {
+        int q = postings.Find(t);
+        if(q < 0) continue;
+        Vector<int>& list = postings[q];
+        int *at = std::lower_bound(list.begin(), list.end(), i);
+        if(at != list.end() && *at == i) list.Remove(int(at - list.begin()));
+    }
+}
+
+void GalleryFilterIndex::Add(const String& name, const String& tags)
+{
+    int i = hay.GetCount();
+    hay.Add(SearchText(name, tags));
+    tag.Add(tags);
+    Link(i);
+    if(result_valid && hay[i].Find(query) >= 0)
+        result.Add(i); // stays sorted: new items come last
+}
+
+void GalleryFilterIndex::Set(int i, const String& name, const String& tags)
+{
+    Unlink(i);
+    hay[i] = SearchText(name, tags);
+    tag[i] = tags;
+    Link(i);
+    result_valid = false;
+}
+
+// Mirrors item removal: postings and the cached result are compacted and renumbered
+void GalleryFilterIndex::Remove(const GalleryBits& drop)
+{
+    Vector<int> to;
+    to.SetCount(hay.GetCount());
+    int j = 0;
+    for(int i = 0; i < hay.GetCount(); ++i) {
+        to[i] = drop[i] ? -1 : j;
+        if(drop[i]) continue;
+        if(j != i) {
+            hay[j] = pick(hay[i]);
+            tag[j] = pick(tag[i]);
+        }
+        j++;
+    }
+    hay.SetCount(j);
+    tag.SetCount(j);
+
+    auto remap = [&](Vector<int>& list) {
+        int k = 0;
+        for(int i : list)
+            if(to[i] >= 0) list[k++] = to[i];
+        list.SetCount(k);
+    };
+    for(Vector<int>& list : postings) remap(list);
+    remap(result);
+}
+
+void GalleryFilterIndex::Clear()
+{
+    hay.Clear();
+    tag.Clear();
+    postings.Clear();
+    result.Clear();
+    query.Clear();
+    result_valid = false;
+}
+
+bool GalleryFilterIndex::Matches(int i, const String& q) const
+{
+    return hay[i].Find(ToLower(q)) >= 0;
+}
+
+// Sorted items whose name or tags contain q (case-insensitive).
+const Vector<int>& GalleryFilterIndex::Query(const String& q_)
+{
+    String q = ToLower(q_);
+    if(result_valid && q == query) return result;
+
+    bool narrowing = result_valid && q.Find(query) >= 0; // every new match was an old match
+    Vector<int> cand;
+    if(narrowing)
+        cand = pick(result);
+    else
+    if(q.GetCount() >= 3) {
+        // Intersect trigram postings, rarest list first
+        Vector<dword> tri;
+        Trigrams(q, tri);
+        Vector<const Vector<int> *> lists;
+        for(dword t : tri) {
+            int k = postings.Find(t);
+            if(k < 0) { lists.Clear(); break; }
+            lists.Add(&postings[k]);
+        }
+        if(lists.GetCount()) {
+            Sort(lists, [](const Vector<int> *a, const Vector<int> *b) { return a->GetCount() < b->GetCount(); });
+            cand = clone(*lists[0]);
+            for(int l = 1; l < lists.GetCount() && cand.GetCount(); ++l) {
+                const Vector<int>& other = *lists[l];
+                const int *lo = other.begin();
+                int k = 0;
+                for(int i : cand) {
+                    lo = std::lower_bound(lo, other.end(), i);
+                    if(lo == other.end()) break;
+                    if(*lo == i) cand[k++] = i;
+                }
+                cand.SetCount(k);
+            }
+        }
+    }
+    else {
+        cand.SetCount(hay.GetCount());
+        for(int i = 0; i < cand.GetCount(); ++i) cand[i] = i;
+    }
+
+    // Trigrams are necessary, not sufficient: verify the survivors
+    result.Clear();
+    for(int i : cand)
+        if(hay[i].Find(q) >= 0) result.Add(i);
+    query = q;
+    result_valid = true;
+    return result;
+}
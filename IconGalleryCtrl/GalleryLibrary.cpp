@@ -0,0 +1,469 @@
+#include "IconGalleryCtrl.h"
+#include <plugin/png/png.h>
+
+// Library file layout (little endian):
+//   header: "IGLB" | int32 version | int32 pixel layout | int32 0 | int64 table offset | int64 table length
+//   blobs:  sources (encoded image files) and thumbnails (tile*tile premultiplied RGBA), any order
+//   table:  int32 count, then one column after another:
+//           name_at int32[count + 1] | names | seed int32[count] (0xRRGGBB, -1 = Null) | status byte[count]
+//           tags_at int32[count + 1] | tags  | src_off int64[count] | src_len int32[count]
+//           thumb_at int32[count + 1] | thumbs: { int32 tile | int64 offset }[thumb_at[count]]
+// A save appends the new blobs and a new table, and only then rewrites the table pointer in the
+// header: a torn save leaves the previous table in charge. Earlier tables and blobs no record
+// refers to any more stay behind until Compact().
+
+static const char sLibMagic[4] = { 'I', 'G', 'L', 'B' };
+enum { LIB_VERSION = 1, LIB_HEADER = 32, LIB_MAX_TILE = 4096 };
+
+static int PixelLayout() { return (int)offsetof(RGBA, r) | (int)offsetof(RGBA, a) << 8; }
+
+// ---------------- Open / close ----------------
+bool GalleryLibrary::Open(const String& path_)
+{
+    Close();
+    Mutex::Lock __(lock);
+    path = path_;
+    if(FileExists(path) && !MapTable()) { // a library is user data: never deleted, just refused
+        map.Close();
+        count = 0;
+        path.Clear();
+        return false;
+    }
+    return true;
+}
+
+void GalleryLibrary::Close()
+{
+    Mutex::Lock __(lock);
+    map.Close();
+    count = 0;
+    path.Clear();
+}
+
+// Maps the file and checks every column and blob reference once, so the getters only check
+// the record number: a reader may still hold one from before a Save
+bool GalleryLibrary::MapTable()
+{
+    count = 0;
+    if(!map.Open(path) || !map.Map(0, (size_t)map.GetFileSize()))
+        return false;
+    const byte *b = map.Begin();
+    int64 size = map.GetFileSize();
+    if(size < LIB_HEADER || memcmp(b, sLibMagic, 4) || Peek32le(b + 4) != LIB_VERSION
+       || Peek32le(b + 8) != PixelLayout())
+        return false;
+    int64 at = Peek64le(b + 16), end = at + Peek64le(b + 24);
+    if(at == 0)
+        return true; // nothing saved yet
+    if(at < LIB_HEADER || end < at + 4 || end > size)
+        return false;
+    int n = Peek32le(b + at);
+    if(n < 0)
+        return false;
+
+    int64 p = at + 4;
+    auto take = [&](int64& col, int64 bytes) {
+        col = p;
+        if(bytes < 0 || end - p < bytes) return false;
+        p += bytes;
+        return true;
+    };
+    auto offsets = [&](int64& col) { // 0-based and non-decreasing; the last one, or -1
+        if(!take(col, 4 * (int64)(n + 1)) || Peek32le(b + col)) return -1;
+        int prev = 0;
+        for(int i = 1; i <= n; ++i) {
+            int v = Peek32le(b + col + 4 * i);
+            if(v < prev) return -1;
+            prev = v;
+        }
+        return prev;
+    };
+    int k;
+    if((k = offsets(name_at)) < 0 || !take(names, k) || !take(seeds, 4 * (int64)n) || !take(status, n)
+       || (k = offsets(tags_at)) < 0 || !take(tags, k)
+       || !take(src_off, 8 * (int64)n) || !take(src_len, 4 * (int64)n)
+       || (k = offsets(thumb_at)) < 0 || !take(thumbs, 12 * (int64)k))
+        return false;
+
+    for(int i = 0; i < n; ++i) { // blobs always precede the table that refers to them
+        int64 o = Peek64le(b + src_off + 8 * i);
+        int   l = Peek32le(b + src_len + 4 * i);
+        if(l < 0 || (l && (o < LIB_HEADER || o + l > at)) || b[status + i] > (int)ThumbStatus::Missing)
+            return false;
+    }
+    for(int j = 0; j < k; ++j) {
+        int   tile = Peek32le(b + thumbs + 12 * j);
+        int64 o    = Peek64le(b + thumbs + 12 * j + 4);
+        if(tile <= 0 || tile > LIB_MAX_TILE || o < LIB_HEADER || o + (int64)tile * tile * sizeof(RGBA) > at)
+            return false;
+    }
+    count = n;
+    return true;
+}
+
+// ---------------- Records ----------------
+String GalleryLibrary::Slice(int64 at_col, int64 pool, int i) const
+{
+    const byte *b = map.Begin();
+    int a = Peek32le(b + at_col + 4 * i), e = Peek32le(b + at_col + 4 * i + 4);
+    return String((const char *)b + pool + a, e - a);
+}
+
+String GalleryLibrary::GetName(int i) const
+{
+    Mutex::Lock __(lock);
+    return IsRecord(i) ? Slice(name_at, names, i) : String();
+}
+
+String GalleryLibrary::GetTags(int i) const
+{
+    Mutex::Lock __(lock);
+    return IsRecord(i) ? Slice(tags_at, tags, i) : String();
+}
+
+Color GalleryLibrary::GetSeed(int i) const
+{
+    Mutex::Lock __(lock);
+    int c = IsRecord(i) ? Peek32le(map.Begin() + seeds + 4 * i) : -1;
+    return c < 0 ? Color(Null) : Color((c >> 16) & 255, (c >> 8) & 255, c & 255);
+}
+
+ThumbStatus GalleryLibrary::GetStatus(int i) const
+{
+    Mutex::Lock __(lock);
+    return IsRecord(i) ? (ThumbStatus)map.Begin()[status + i] : ThumbStatus::Auto;
+}
+
+bool GalleryLibrary::HasImage(int i) const
+{
+    Mutex::Lock __(lock);
+    if(!IsRecord(i)) return false;
+    const byte *b = map.Begin();
+    return Peek32le(b + src_len + 4 * i) > 0 || Peek32le(b + thumb_at + 4 * i + 4) > Peek32le(b + thumb_at + 4 * i);
+}
+
+void GalleryLibrary::GetThumbs(int i, Vector<Thumb>& out) const
+{
+    const byte *b = map.Begin();
+    out.Clear();
+    if(!IsRecord(i)) return;
+    for(int j = Peek32le(b + thumb_at + 4 * i); j < Peek32le(b + thumb_at + 4 * i + 4); ++j) {
+        Thumb& t = out.Add();
+        t.tile   = Peek32le(b + thumbs + 12 * j);
+        t.offset = Peek64le(b + thumbs + 12 * j + 4);
+    }
+}
+
+Image GalleryLibrary::GetSource(int i) const
+{
+    String data;
+    {
+        Mutex::Lock __(lock);
+        if(!IsRecord(i)) return Image();
+        const byte *b = map.Begin();
+        data = String((const char *)b + Peek64le(b + src_off + 8 * i), Peek32le(b + src_len + 4 * i));
+    }
+    return data.GetCount() ? StreamRaster::LoadStringAny(data) : Image();
+}
+
+// The exact tile, else the smallest larger one, else (only when there is no source to decode
+// instead) the largest smaller one. Pixels are copied out under the lock, scaled outside it.
+Image GalleryLibrary::GetThumb(int i, int tile) const
+{
+    ImageBuffer ib;
+    {
+        Mutex::Lock __(lock);
+        Vector<Thumb> t;
+        GetThumbs(i, t);
+        auto rank = [&](int x) { return x == tile ? 0 : x > tile ? 1 : 2; };
+        const Thumb *best = nullptr;
+        for(const Thumb& h : t) {
+            if(!best) { best = &h; continue; }
+            int ra = rank(h.tile), rb = rank(best->tile);
+            if(ra < rb || (ra == rb && (ra == 1 ? h.tile < best->tile : h.tile > best->tile)))
+                best = &h;
+        }
+        if(!best || (rank(best->tile) == 2 && Peek32le(map.Begin() + src_len + 4 * i) > 0))
+            return Image();
+        ib.Create(best->tile, best->tile);
+        memcpy(ib.Begin(), map.Begin() + best->offset, ib.GetLength() * sizeof(RGBA));
+    }
+    Image m = ib;
+    return ResampleImage(m, Size(tile, tile)); // stored thumbs are square
+}
+
+// ---------------- Saving ----------------
+// append: new blobs go after the existing ones and reused rows keep their offsets.
+// Otherwise (compaction) file is written from scratch and reused blobs are copied over.
+bool GalleryLibrary::Write(const String& file, const Vector<GalleryLibraryRow>& rows, bool append)
+{
+    int n = rows.GetCount();
+    Vector<int64>         soff;
+    Vector<int>           slen;
+    Vector<Vector<Thumb>> th;
+    soff.SetCount(n, 0);
+    slen.SetCount(n, 0);
+    th.SetCount(n);
+    for(int i = 0; i < n; ++i) { // where the reused blobs are, read while still mapped
+        int f = rows[i].from;
+        if(f < 0) continue;
+        ASSERT(f < count);
+        soff[i] = Peek64le(map.Begin() + src_off + 8 * f);
+        slen[i] = Peek32le(map.Begin() + src_len + 4 * f);
+        GetThumbs(f, th[i]);
+    }
+    if(append)
+        map.Close(); // a mapped file cannot grow on every platform
+
+    FileStream out;
+    if(append && FileExists(file) ? !out.Open(file, FileStream::READWRITE) : !out.Open(file, FileStream::CREATE))
+        return false;
+    if(out.GetSize() < LIB_HEADER) {
+        out.SetSize(0);
+        out.Put(sLibMagic, 4);
+        out.Put32le(LIB_VERSION);
+        out.Put32le(PixelLayout());
+        out.Put32le(0);
+        out.Put64le(0);
+        out.Put64le(0);
+    }
+    out.SeekEnd();
+
+    for(int i = 0; i < n; ++i) {
+        const GalleryLibraryRow& r = rows[i];
+        if(r.from >= 0) {
+            if(append) continue;
+            if(slen[i]) {
+                int64 at = out.GetPos();
+                out.Put(map.Begin() + soff[i], slen[i]);
+                soff[i] = at;
+            }
+            for(Thumb& t : th[i]) {
+                int64 at = out.GetPos();
+                out.Put(map.Begin() + t.offset, t.tile * t.tile * (int)sizeof(RGBA));
+                t.offset = at;
+            }
+            continue;
+        }
+        if(r.src.GetCount()) {
+            soff[i] = out.GetPos();
+            slen[i] = r.src.GetCount();
+            out.Put(r.src);
+        }
+        for(const Image& m : r.thumbs) {
+            Size sz = m.GetSize();
+            if(sz.cx != sz.cy || sz.cx <= 0 || sz.cx > LIB_MAX_TILE) continue;
+            Thumb& t = th[i].Add();
+            t.tile   = sz.cx;
+            t.offset = out.GetPos();
+            out.Put(m.Begin(), int(m.GetLength() * sizeof(RGBA)));
+        }
+    }
+
+    int64 table = out.GetPos();
+    auto put_offsets = [&](auto len) {
+        int a = 0;
+        out.Put32le(0);
+        for(int i = 0; i < n; ++i)
+            out.Put32le(a += len(i));
+    };
+    out.Put32le(n);
+    put_offsets([&](int i) { return rows[i].name.GetCount(); });
+    for(const GalleryLibraryRow& r : rows)
+        out.Put(r.name);
+    for(const GalleryLibraryRow& r : rows)
+        out.Put32le(IsNull(r.seed) ? -1 : (r.seed.GetR() << 16) | (r.seed.GetG() << 8) | r.seed.GetB());
+    for(const GalleryLibraryRow& r : rows)
+        out.Put((int)r.status);
+    put_offsets([&](int i) { return rows[i].tags.GetCount(); });
+    for(const GalleryLibraryRow& r : rows)
+        out.Put(r.tags);
+    for(int i = 0; i < n; ++i)
+        out.Put64le(soff[i]);
+    for(int i = 0; i < n; ++i)
+        out.Put32le(slen[i]);
+    put_offsets([&](int i) { return th[i].GetCount(); });
+    for(const Vector<Thumb>& list : th)
+        for(const Thumb& t : list) {
+            out.Put32le(t.tile);
+            out.Put64le(t.offset);
+        }
+    int64 len = out.GetPos() - table;
+
+    out.Flush(); // the table is complete before the header points at it
+    out.Seek(16);
+    out.Put64le(table);
+    out.Put64le(len);
+    bool ok = !out.IsError();
+    out.Close();
+    return ok;
+}
+
+bool GalleryLibrary::Save(const Vector<GalleryLibraryRow>& rows)
+{
+    Mutex::Lock __(lock);
+    if(IsNull(path)) return false;
+    bool ok = Write(path, rows, true);
+    map.Close();
+    return MapTable() && ok; // on failure the header still names the previous table
+}
+
+bool GalleryLibrary::Compact()
+{
+    if(!count) return IsOpen();
+    Vector<GalleryLibraryRow> rows;
+    rows.SetCount(count);
+    for(int i = 0; i < count; ++i) {
+        GalleryLibraryRow& r = rows[i];
+        r.name   = GetName(i);
+        r.tags   = GetTags(i);
+        r.seed   = GetSeed(i);
+        r.status = GetStatus(i);
+        r.from   = i; // record numbers stay the same
+    }
+    Mutex::Lock __(lock);
+    String tmp = path + ".tmp";
+    if(!Write(tmp, rows, false)) {
+        DeleteFile(tmp);
+        return false;
+    }
+    map.Close();
+    bool moved = GalleryReplaceFile(tmp, path); // the library is never without a file
+    if(!moved)
+        DeleteFile(tmp);
+    return MapTable() && moved;
+}
+
+int64 GalleryLibrary::GetBytes() const
+{
+    Mutex::Lock __(lock);
+    return map.IsOpen() ? map.GetFileSize() : 0;
+}
+
+int64 GalleryLibrary::GetLiveBytes() const
+{
+    Mutex::Lock __(lock);
+    if(!map.IsOpen()) return 0;
+    const byte *b = map.Begin();
+    int64 n = LIB_HEADER + Peek64le(b + 24);
+    Vector<Thumb> t;
+    for(int i = 0; i < count; ++i) {
+        n += Peek32le(b + src_len + 4 * i);
+        GetThumbs(i, t);
+        for(const Thumb& h : t)
+            n += (int64)h.tile * h.tile * sizeof(RGBA);
+    }
+    return n;
+}
+
+// ---------------- Gallery side ----------------
+void IconGalleryCtrl::OpenLibrary(const GalleryLibrary& lib)
+{
+    DoRemoveAll();
+    int n = lib.GetCount();
+    items.SetLibrary(&lib);
+    items.Reserve(n);
+    for(int i = 0; i < n; ++i) {
+        int q = items.Add(lib.GetName(i), lib.GetSeed(i));
+        items.SetStatus(q, lib.GetStatus(i));
+        items.SetLibRecord(q, lib.HasImage(i) ? i : -1);
+    }
+    selection.SetCount(n);
+    filtered.SetCount(n);
+    for(int i = 0; i < n; ++i)
+        search.Add(items.GetName(i), lib.GetTags(i));
+    if(!IsNull(filter_text))
+        ApplyFilterText();
+    ViewAdded(0);
+    Changed();
+}
+
+// Items still backed by this library keep their records, so their blobs are not written again.
+// New sources are stored as PNG (or as the file bytes for file-backed items) and scaled to
+// the thumbnail tiles, in parallel.
+bool IconGalleryCtrl::SaveLibrary(GalleryLibrary& lib, const Vector<int>& tiles_)
+{
+    if(!lib.IsOpen()) return false;
+    Vector<int> tiles = clone(tiles_);
+    if(tiles.IsEmpty())
+        tiles.Add(zoom_steps[zoom_i]);
+    bool same = items.GetLibrary() == &lib;
+    int n = items.GetCount();
+    Vector<GalleryLibraryRow> rows;
+    rows.SetCount(n);
+    // Virtual: metadata straight from the provider, here on the GUI thread; the store's row
+    // cache is GUI-only and would otherwise pull in every row. Only GetThumb runs on workers.
+    const GalleryProvider *vp = items.GetProvider();
+    Vector<bool> vthumb;
+    if(vp)
+        for(int i = 0; i < n; ++i) {
+            GalleryLibraryRow& r = rows[i];
+            r.name   = vp->GetName(i);
+            Color c  = vp->GetSeed(i);
+            r.seed   = IsNull(c) ? GalleryNameColor(r.name) : c;
+            r.status = vp->GetStatus(i);
+            vthumb.Add(vp->HasThumb(i));
+        }
+    CoPartition(0, n, [&](int a, int b) {
+        for(int i = a; i < b; ++i) {
+            GalleryLibraryRow& r = rows[i];
+            Image src;
+            if(vp) {
+                if(!vthumb[i]) continue;
+                src = vp->GetThumb(i, 0);
+                if(!src.IsEmpty())
+                    r.src = PNGEncoder().SaveString(src);
+            }
+            else {
+                r.name   = items.GetName(i);
+                r.tags   = search.GetTags(i);
+                r.seed   = items.GetSeed(i);
+                r.status = items.GetStatus(i);
+                if(!items.HasImage(i)) continue;
+                int rec = items.GetLibRecord(i);
+                if(same && rec >= 0) {
+                    r.from = rec;
+                    continue;
+                }
+                const GalleryPayload *p = items.GetPayload(i);
+                src = items.GetSource(i);
+                if(src.IsEmpty() && p && !IsNull(p->src_path)) {
+                    r.src = LoadFile(p->src_path);
+                    src = StreamRaster::LoadStringAny(r.src);
+                }
+                else
+                if(!src.IsEmpty())
+                    r.src = PNGEncoder().SaveString(src);
+            }
+            if(src.IsEmpty()) {
+                r.src.Clear();
+                continue;
+            }
+            for(int t : tiles)
+                r.thumbs.Add(ResampleThumb(src, t)); // default fit and quality, see ThumbVariant
+        }
+    });
+
+    // Queued and running jobs read the library by the old record numbers, and Save renumbers
+    // and remaps it: they are cancelled and waited for before it runs. The renumbered items
+    // get a new revision, so their tiles are rebuilt. Virtual jobs read the provider instead.
+    if(!IsVirtual()) {
+        CancelThumbs();
+        thumb_work.Finish();
+        items.ClearFlag(GalleryItemStore::QUEUED);
+    }
+    if(!lib.Save(rows))
+        return false;
+    if(IsVirtual())
+        return true; // a snapshot; the items stay with the provider
+    items.SetLibrary(&lib); // record i is now item i
+    for(int i = 0; i < n; ++i) {
+        int rec = lib.HasImage(i) ? i : -1;
+        if(items.GetLibRecord(i) != rec) {
+            items.SetLibRecord(i, rec);
+            items.Touch(i);
+        }
+    }
+    Refresh();
+    return true;
+}
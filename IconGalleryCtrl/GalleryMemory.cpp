@@ -0,0 +1,69 @@
+#include "IconGalleryCtrl.h"
+
+// Thumbnail memory budget. One pass over the payloads measures the cached levels and the
+// reloadable sources; past the budget they are dropped least recently visible first, down to
+// 3/4 of it, so the next pass is a good while of new thumbs away.
+
+static int64 Bytes(const Image& m) { return (int64)m.GetLength() * sizeof(RGBA); }
+
+int64 IconGalleryCtrl::GetThumbBytes()
+{
+    int64 n = 0;
+    items.ForEachPayload([&](GalleryPayload& p) {
+        if(!IsNull(p.src_path))
+            n += Bytes(p.src);
+        for(const ThumbMip& m : p.mip)
+            n += Bytes(m.normal) + Bytes(m.gray);
+    });
+    return n;
+}
+
+void IconGalleryCtrl::TrimThumbs()
+{
+    struct Victim : Moveable<Victim> {
+        int             stamp;
+        GalleryPayload *p;
+        int             slot; // mip slot, -1 = the source
+    };
+    Vector<Victim> v;
+    int64 total = 0;
+    items.ForEachPayload([&](GalleryPayload& p) {
+        if(!IsNull(p.src_path) && !p.src.IsEmpty()) {
+            total += Bytes(p.src);
+            if(evict_src) v.Add({ p.seen, &p, -1 });
+        }
+        for(int k = 0; k < THUMB_MIP_SLOTS; ++k) {
+            const ThumbMip& m = p.mip[k];
+            int64 b = Bytes(m.normal) + Bytes(m.gray);
+            if(b) {
+                total += b;
+                v.Add({ m.stamp, &p, k });
+            }
+        }
+    });
+    thumb_grown = 0;
+    thumb_bytes = total;
+    if(thumb_budget <= 0 || total <= thumb_budget)
+        return;
+
+    Sort(v, [](const Victim& a, const Victim& b) { return a.stamp < b.stamp; });
+    int64 target = thumb_budget / 4 * 3;
+    for(const Victim& x : v) {
+        if(total <= target || x.stamp >= paint_frame) // the rest is in view or just arrived
+            break;
+        GalleryPayload& p = *x.p;
+        if(x.slot < 0) {
+            total -= Bytes(p.src);
+            p.src = Image();
+            evicted_src++;
+        }
+        else {
+            ThumbMip& m = p.mip[x.slot];
+            total -= Bytes(m.normal) + Bytes(m.gray);
+            m.zi = -1;
+            m.normal = m.gray = Image();
+            evicted_thumbs++;
+        }
+    }
+    thumb_bytes = total;
+}
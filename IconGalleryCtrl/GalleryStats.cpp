@@ -0,0 +1,93 @@
+#include "IconGalleryCtrl.h"
+
+// Frame statistics and the HUD overlay. Nothing here runs unless instrumentation is on.
+
+void IconGalleryCtrl::SetInstrumentation(bool b)
+{
+    hud_instrument = false; // the application's setting from now on
+    if(b == instrument) return;
+    instrument = b;
+    stats = acc = GalleryStats();
+    frame_times.Clear();
+}
+
+void IconGalleryCtrl::ShowHud(bool b)
+{
+    if(b == show_hud) return;
+    show_hud = b;
+    if(b && !instrument) {
+        SetInstrumentation(true);
+        hud_instrument = true;
+    }
+    else
+    if(!b && hud_instrument)
+        SetInstrumentation(false);
+    Refresh();
+}
+
+// Called at the end of an instrumented Paint: snapshots the queue, the cache sizes and
+// the frame that was just measured, then starts a fresh accumulator
+void IconGalleryCtrl::PublishStats()
+{
+    {
+        Mutex::Lock __(thumb_lock);
+        acc.queue_depth = thumb_queue.GetCount();
+        acc.workers     = thumb_workers;
+        acc.io          = thumb_io;
+    }
+    acc.pending_loads = loading_count;
+    acc.composite_bytes = 0;
+    for(const GalleryTileComposite& c : composites)
+        for(const Image& m : c.variant)
+            acc.composite_bytes += (int64)m.GetLength() * sizeof(RGBA);
+    acc.atlas_bytes = GalleryTileAtlas::GetBytes();
+    acc.disk_bytes  = disk_cache ? disk_cache->GetBytes() : 0;
+    acc.thumb_bytes = thumb_bytes + thumb_grown; // estimate, exact after each budget check
+    acc.evicted     = evicted_thumbs + evicted_src;
+    acc.frame = stats.frame + 1;
+
+    stats = acc;
+    acc = GalleryStats();
+
+    frame_times.AddTail((int)stats.paint_us);
+    while(frame_times.GetCount() > hud_frames)
+        frame_times.DropHead();
+
+    WhenStats(stats);
+}
+
+Rect IconGalleryCtrl::HudRect() const
+{
+    Size sz = GetSize();
+    return RectC(sz.cx - 8 - 200, 8, 200, 64);
+}
+
+// Sparkline of the last frame times, scaled to the slowest one, plus the current numbers
+void IconGalleryCtrl::PaintHud(Draw& w) const
+{
+    Rect r = HudRect();
+    w.DrawRect(r, Blend(Black(), SColorPaper(), 64));
+    Font fnt = StdFont().Height(Zy(10));
+    int fy = fnt.GetCy();
+    w.DrawText(r.left + 4, r.top + 2,
+               Format("%d us  tiles %d  miss %d/%d  queue %d", (int)stats.paint_us, stats.tiles,
+                      stats.composite_misses, stats.thumb_misses, stats.queue_depth),
+               fnt, White());
+
+    Rect g(r.left + 4, r.top + fy + 4, r.right - 4, r.bottom - 4);
+    int n = frame_times.GetCount();
+    if(n < 2) return;
+    int peak = 1;
+    for(int t : frame_times) peak = max(peak, t);
+    int budget = 16667; // one 60 Hz frame
+    if(budget < peak) {
+        int by = g.bottom - g.Height() * budget / peak;
+        w.DrawRect(g.left, by, g.Width(), 1, LtRed());
+    }
+    Vector<Point> pts;
+    pts.SetCount(n);
+    for(int i = 0; i < n; ++i)
+        pts[i] = Point(g.left + g.Width() * i / (hud_frames - 1),
+                       g.bottom - g.Height() * frame_times[i] / peak);
+    w.DrawPolyline(pts, 1, LtGreen());
+}
@@ -0,0 +1,234 @@
+#include "IconGalleryCtrl.h"
+
+Color GalleryNameColor(const String& name)
+{
+    unsigned acc = 0;
+    for(byte ch : name) acc = acc * 131 + ch;
+    double h  = (acc % 360) / 360.0;
+    double sN = 0.45 + ((acc % 60) / 60.0) * 0.25;
+    double vN = 0.55 + (((acc / 7) % 50) / 50.0) * 0.25;
+    return HsvColorf(h, sN, vN);
+}
+
+int GalleryItemStore::Add(const String& name, Color c)
+{
+    ASSERT(!provider);
+    pool.Cat(name);
+    name_at.Add(pool.GetCount());
+    seed.Add(c);
+    status.Add((byte)ThumbStatus::Auto);
+    flags.Add(0);
+    rev.Add(0);
+    payload.Add();
+    if(library) lib.Add(-1);
+    return seed.GetCount() - 1;
+}
+
+void GalleryItemStore::Reserve(int n)
+{
+    name_at.Reserve(n + 1);
+    seed.Reserve(n);
+    status.Reserve(n);
+    flags.Reserve(n);
+    rev.Reserve(n);
+    payload.Reserve(n);
+    if(library) lib.Reserve(n);
+}
+
+void GalleryItemStore::Clear()
+{
+    pool.Clear();
+    name_at.Clear();
+    name_at.Add(0);
+    seed.Clear();
+    status.Clear();
+    flags.Clear();
+    rev.Clear();
+    payload.Clear();
+    lib.Clear();
+    library = nullptr;
+    vrow.Clear();
+    vname.Clear();
+    provider = nullptr;
+    vcount = 0;
+}
+
+// Compacts every column in one pass; payloads are moved, never copied
+void GalleryItemStore::Remove(const GalleryBits& drop)
+{
+    ASSERT(!provider);
+    StringBuffer np;
+    Vector<int> nat;
+    nat.Reserve(GetCount() - drop.GetSetCount() + 1);
+    nat.Add(0);
+    int j = 0;
+    for(int i = 0; i < GetCount(); ++i) {
+        if(drop[i]) continue;
+        np.Cat(~pool + name_at[i], name_at[i + 1] - name_at[i]);
+        nat.Add(np.GetCount());
+        if(j != i) {
+            seed[j]    = seed[i];
+            status[j]  = status[i];
+            flags[j]   = flags[i];
+            rev[j]     = rev[i];
+            payload[j] = pick(payload[i]);
+            if(lib.GetCount()) lib[j] = lib[i];
+        }
+        j++;
+    }
+    pool = np;
+    name_at = pick(nat);
+    seed.SetCount(j);
+    status.SetCount(j);
+    flags.SetCount(j);
+    rev.SetCount(j);
+    payload.SetCount(j);
+    if(lib.GetCount()) lib.SetCount(j);
+}
+
+int GalleryItemStore::CompareName(int a, int b) const
+{
+    const byte *p = (const byte *)~pool + name_at[a], *pe = (const byte *)~pool + name_at[a + 1];
+    const byte *q = (const byte *)~pool + name_at[b], *qe = (const byte *)~pool + name_at[b + 1];
+    for(; p < pe && q < qe; ++p, ++q)
+        if(int d = ToLower(*p) - ToLower(*q))
+            return d;
+    return SgnCompare(pe - p, qe - q);
+}
+
+void GalleryItemStore::ClearFlag(int f)
+{
+    for(byte& b : flags) b &= ~f;
+}
+
+GalleryPayload& GalleryItemStore::PayloadAdd(int i)
+{
+    One<GalleryPayload>& p = payload[Row(i)];
+    if(p.IsEmpty()) p.Create();
+    return *p;
+}
+
+bool GalleryItemStore::HasImage(int i) const
+{
+    int r = Row(i);
+    const GalleryPayload *p = ~payload[r];
+    return (p && (!p->src.IsEmpty() || !IsNull(p->src_path))) || GetLibRecord(i) >= 0 || (flags[r] & VTHUMB);
+}
+
+Image GalleryItemStore::GetSource(int i) const
+{
+    int r = Row(i);
+    const GalleryPayload *p = ~payload[r];
+    if(p && !p->src.IsEmpty())
+        return p->src;
+    if(flags[r] & VTHUMB)
+        return provider->GetThumb(i, 0);
+    int rec = GetLibRecord(i);
+    return rec >= 0 ? library->GetSource(rec) : Image();
+}
+
+void GalleryItemStore::Touch(int i)
+{
+    int r = Row(i);
+    rev[r] = provider ? ++vserial : rev[r] + 1;
+}
+
+// ---------------- Virtual mode ----------------
+void GalleryItemStore::SetProvider(const GalleryProvider *p)
+{
+    Clear();
+    provider = p;
+    vcount = p ? p->GetCount() : 0;
+}
+
+// A cache miss on a const getter: the row is filled from the provider. The cache is not
+// part of the store's observable state, hence the cast.
+int GalleryItemStore::Fetch(int i) const
+{
+    ASSERT(provider && i >= 0 && i < vcount);
+    GalleryItemStore& m = const_cast<GalleryItemStore&>(*this);
+    String n = provider->GetName(i);
+    Color  c = provider->GetSeed(i);
+    m.vrow.Add(i);
+    m.seed.Add(IsNull(c) ? GalleryNameColor(n) : c);
+    m.vname.Add(n);
+    m.status.Add((byte)provider->GetStatus(i));
+    m.flags.Add(provider->HasThumb(i) ? VTHUMB : 0);
+    m.rev.Add(++m.vserial);
+    m.payload.Add();
+    return vrow.GetCount() - 1;
+}
+
+// Swap-remove: the last row moves into r
+void GalleryItemStore::DropRow(int r)
+{
+    int t = vrow.GetCount() - 1;
+    if(r != t) {
+        vrow.Set(r, vrow[t]);
+        vname[r]   = pick(vname[t]);
+        seed[r]    = seed[t];
+        status[r]  = status[t];
+        flags[r]   = flags[t];
+        rev[r]     = rev[t];
+        payload[r] = pick(payload[t]);
+    }
+    vrow.Drop();
+    vname.Drop();
+    seed.Drop();
+    status.Drop();
+    flags.Drop();
+    rev.Drop();
+    payload.Drop();
+}
+
+void GalleryItemStore::Invalidate(int i)
+{
+    int r = provider ? vrow.Find(i) : -1;
+    if(r >= 0) DropRow(r);
+}
+
+// Rows above r are kept or were moved down already, so one backwards pass visits each once.
+// Rows with a job or a load in flight stay until it is done.
+void GalleryItemStore::TrimVirtual(int first, int last, int max_rows)
+{
+    if(!provider || vrow.GetCount() <= max_rows) return;
+    for(int r = vrow.GetCount() - 1; r >= 0; --r) {
+        int i = vrow[r];
+        if((i < first || i > last) && !(flags[r] & (QUEUED | LOADING)))
+            DropRow(r);
+    }
+}
+
+// Attaching adds the record column (all -1), detaching drops it
+void GalleryItemStore::SetLibrary(const GalleryLibrary *l)
+{
+    library = l;
+    if(l)
+        lib.SetCount(GetCount(), -1);
+    else
+        lib.Clear();
+}
+
+int GalleryItemStore::GetPayloadCount() const
+{
+    int n = 0;
+    for(const One<GalleryPayload>& p : payload) n += !p.IsEmpty();
+    return n;
+}
+
+size_t GalleryItemStore::GetMemory() const
+{
+    size_t m = pool.GetLength()
+             + name_at.GetCount() * sizeof(int)
+             + seed.GetCount() * sizeof(Color)
+             + status.GetCount() + flags.GetCount()
+             + rev.GetCount() * sizeof(int)
+             + payload.GetCount() * sizeof(One<GalleryPayload>)
+             + lib.GetCount() * sizeof(int)
+             + vrow.GetCount() * (sizeof(int) + sizeof(String));
+    for(const One<GalleryPayload>& p : payload)
+        if(!p.IsEmpty()) m += sizeof(GalleryPayload) + p->src_path.GetLength();
+    for(const String& n : vname)
+        m += n.GetLength();
+    return m;
+}
@@ -0,0 +1,177 @@
+#include "IconGalleryCtrl.h"
+
+// Display order is a permutation of item indices: sorting, hiding and compacting
+// only move ints, the items (and their images) stay where they are.
+
+// ---------------- Ordering ----------------
+int IconGalleryCtrl::HueKey(int i) const {
+    Color c = items.GetSeed(i);
+    double h, s, v;
+    RGBtoHSV(c.GetR() / 255.0, c.GetG() / 255.0, c.GetB() / 255.0, h, s, v);
+    return s < 0.08 ? 4000 + int(v * 100) : int(h * 3600); // grays after the hue wheel
+}
+
+bool IconGalleryCtrl::ViewLess(int a, int b) const {
+    int q = 0;
+    switch(sort_by) {
+    case SORT_NAME:
+        q = items.CompareName(a, b);
+        break;
+    case SORT_COLOR:
+        q = SgnCompare(sort_hue[a], sort_hue[b]);
+        break;
+    case SORT_STATUS:
+        q = SgnCompare((int)items.GetStatus(a), (int)items.GetStatus(b));
+        if(!q) q = items.CompareName(a, b);
+        break;
+    }
+    if(sort_desc) q = -q;
+    return q ? q < 0 : a < b; // ties keep insertion order, so the order is total
+}
+
+void IconGalleryCtrl::RebuildOrder() {
+    if(IsVirtual()) return; // the view is the identity, never materialized
+    int n = items.GetCount();
+    sort_hue.Clear();
+    if(sort_by == SORT_COLOR) {
+        sort_hue.SetCount(n);
+        CoPartition(0, n, [&](int a, int b) {
+            for(int i = a; i < b; ++i) sort_hue[i] = HueKey(i);
+        });
+    }
+    status_moved.Clear(); // sorted from scratch below
+    order.SetCount(n);
+    for(int i = 0; i < n; ++i) order[i] = i;
+    if(sort_by != SORT_NONE)
+        CoSort(order, [&](int a, int b) { return ViewLess(a, b); });
+    view_dirty = true;
+}
+
+void IconGalleryCtrl::RebuildView() {
+    FlushStatusMoves();
+    view_dirty = false;
+    if(IsVirtual()) return;
+    view.Clear();
+    view.Reserve(order.GetCount());
+    for(int i : order)
+        if(!hide_filtered || !filtered[i]) view.Add(i);
+    slot_of.SetCount(items.GetCount());
+    Fill(slot_of.begin(), slot_of.end(), -1);
+    for(int slot = 0; slot < view.GetCount(); ++slot)
+        slot_of[view[slot]] = slot;
+    view_identity = sort_by == SORT_NONE && view.GetCount() == items.GetCount();
+}
+
+void IconGalleryCtrl::SetSort(int by, bool descending) {
+    if(IsVirtual() || (by == sort_by && descending == sort_desc)) return;
+    sort_by   = by;
+    sort_desc = descending;
+    RebuildOrder();
+    Changed();
+}
+
+void IconGalleryCtrl::SetHideFiltered(bool b) {
+    if(IsVirtual() || b == hide_filtered) return;
+    hide_filtered = b;
+    ViewChanged();
+}
+
+// ---------------- Incremental updates ----------------
+// Items first..end were just appended
+void IconGalleryCtrl::ViewAdded(int first) {
+    FlushStatusMoves(); // the inserts below need a sorted order
+    int n = items.GetCount();
+    if(sort_by == SORT_NONE) {
+        for(int i = first; i < n; ++i) order.Add(i);
+        if(view_dirty || hide_filtered) // new items may already be filtered out
+            view_dirty = true;
+        else { // plain append keeps view == order == identity
+            slot_of.SetCount(n);
+            for(int i = first; i < n; ++i) {
+                slot_of[i] = view.GetCount();
+                view.Add(i);
+            }
+        }
+        return;
+    }
+
+    if(sort_by == SORT_COLOR) {
+        sort_hue.SetCount(n);
+        for(int i = first; i < n; ++i) sort_hue[i] = HueKey(i);
+    }
+    auto less = [&](int a, int b) { return ViewLess(a, b); };
+    if(n - first == 1) { // single Add: binary insert
+        order.Insert(int(std::lower_bound(order.begin(), order.end(), first, less) - order.begin()), first);
+    }
+    else { // sort the new block, then one linear merge
+        Vector<int> block;
+        block.SetCount(n - first);
+        for(int i = first; i < n; ++i) block[i - first] = i;
+        CoSort(block, less);
+        Vector<int> merged;
+        merged.SetCount(n);
+        std::merge(order.begin(), order.end(), block.begin(), block.end(), merged.begin(), less);
+        order = pick(merged);
+    }
+    view_dirty = true;
+}
+
+// Items set in drop were removed and the rest compacted; drop is indexed by the old items
+void IconGalleryCtrl::ViewRemoved(const GalleryBits& drop) {
+    Vector<int> remap;
+    remap.SetCount(drop.GetCount());
+    int k = 0;
+    for(int i = 0; i < remap.GetCount(); ++i)
+        remap[i] = drop[i] ? -1 : k++;
+    // the remap is monotonic, so order stays sorted (ties break on the index)
+    int j = 0;
+    for(int i : order)
+        if(remap[i] >= 0) order[j++] = remap[i];
+    order.SetCount(j);
+    j = 0;
+    for(int i : status_moved)
+        if(remap[i] >= 0) status_moved[j++] = remap[i];
+    status_moved.SetCount(j);
+    if(sort_hue.GetCount()) {
+        j = 0;
+        for(int i = 0; i < sort_hue.GetCount(); ++i)
+            if(remap[i] >= 0) sort_hue[j++] = sort_hue[i];
+        sort_hue.SetCount(j);
+    }
+    view_dirty = true;
+}
+
+// An item's status changed while sorting by status. It is only noted here: the thumbnail
+// drain reports a whole batch of finished loads, which FlushStatusMoves then re-positions in
+// one pass at the next RebuildView.
+void IconGalleryCtrl::StatusChanged(int i) {
+    if(sort_by != SORT_STATUS) return;
+    status_moved.Add(i);
+    ViewChanged();
+}
+
+// The moved items are taken out of order, sorted and merged back in: O(n + k log k) for k
+// moves instead of O(n) each. The rest of order kept its keys, so it is still sorted.
+void IconGalleryCtrl::FlushStatusMoves() {
+    if(status_moved.IsEmpty()) return;
+    Vector<bool> moved;
+    moved.SetCount(items.GetCount(), false);
+    Vector<int> block;
+    for(int i : status_moved)
+        if(!moved[i]) {
+            moved[i] = true;
+            block.Add(i);
+        }
+    status_moved.Clear();
+    int j = 0;
+    for(int i : order)
+        if(!moved[i]) order[j++] = i;
+    order.SetCount(j);
+    auto less = [&](int a, int b) { return ViewLess(a, b); };
+    Sort(block, less);
+    Vector<int> merged;
+    merged.SetCount(j + block.GetCount());
+    std::merge(order.begin(), order.end(), block.begin(), block.end(), merged.begin(), less);
+    order = pick(merged);
+    view_dirty = true;
+}
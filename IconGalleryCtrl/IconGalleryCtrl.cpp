@@ -1,6 +1,7 @@
 #include "IconGalleryCtrl.h"
 
 static inline int ClampInt(int v, int lo, int hi) { return v < lo ? lo : (v > hi ? hi : v); }
+static inline int FloorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
 
 // ---------------- Construction ----------------
 IconGalleryCtrl::IconGalleryCtrl()
@@ -12,108 +13,341 @@ IconGalleryCtrl::IconGalleryCtrl()
     sb.AutoHide();
     sb.NoBox();
     sb.SetLine(20); // wheel step
-    sb.WhenScroll = [=] {
-        scroll_y = sb.GetY();
-        Refresh();
-    };
+    sb.WhenScroll = [=] { SyncScroll(); };
+}
+
+IconGalleryCtrl::~IconGalleryCtrl()
+{
+    CancelThumbs();
+    thumb_work.Finish(); // workers drain an empty queue and return
 }
 
 // ---------------- Item add ----------------
 int IconGalleryCtrl::Add(const String& name, const Image& img, Color tint) {
-    IconGalleryItem it;
-    it.name = name;
-    it.seed = IsNull(tint) ? AutoColorFromText(name) : tint;
+    if(IsVirtual()) return -1;
+    int i = items.Add(name, IsNull(tint) ? GalleryNameColor(name) : tint);
+    if(!img.IsEmpty())
+        items.PayloadAdd(i).src = img;
+
+    selection.SetCount(items.GetCount());
+    filtered.SetCount(items.GetCount());
+    search.Add(name, Null);
+    if(!IsNull(filter_text))
+        filtered.Set(items.GetCount() - 1, !search.Matches(items.GetCount() - 1, filter_text));
+    ViewAdded(items.GetCount() - 1);
+    Changed();
+    return items.GetCount() - 1;
+}
+
+void IconGalleryCtrl::AddDummy(const String& name) { Add(name); }
+
+// ---------------- Batched insertion ----------------
+void IconGalleryCtrl::Changed() {
+    if(update_depth) { update_dirty = true; return; }
+    Reflow(); Refresh();
+}
 
-    if(!img.IsEmpty()) {
-        it.src = img;
-        it.status = ThumbStatus::Auto; // src takes precedence
+void IconGalleryCtrl::EndUpdate() {
+    ASSERT(update_depth > 0);
+    if(--update_depth == 0 && update_dirty) {
+        update_dirty = false;
+        Reflow(); Refresh();
     }
+}
+
+// Adds names[i] (with imgs[i] when present) in one go: storage grows once and
+// the name-hash tints are computed in parallel. Returns the index of the first new item.
+int IconGalleryCtrl::AddRange(const Vector<String>& names, const Vector<Image>& imgs) {
+    int first = items.GetCount();
+    int n     = names.GetCount();
+    if(n == 0 || IsVirtual()) return IsVirtual() ? -1 : first;
+
+    items.Reserve(first + n);
+    for(int i = 0; i < n; ++i)
+        items.Add(names[i], Null);
+    selection.SetCount(first + n);
+    filtered.SetCount(first + n);
+    CoPartition(0, n, [&](int a, int b) {
+        for(int i = a; i < b; ++i)
+            items.SetSeed(first + i, GalleryNameColor(names[i]));
+    });
+    for(int i = 0; i < min(n, imgs.GetCount()); ++i)
+        if(!imgs[i].IsEmpty())
+            items.PayloadAdd(first + i).src = imgs[i];
+    for(int i = 0; i < n; ++i)
+        search.Add(names[i], Null);
+    if(!IsNull(filter_text))
+        for(int i = first; i < first + n; ++i)
+            filtered.Set(i, !search.Matches(i, filter_text));
+    ViewAdded(first);
+
+    Changed();
+    return first;
+}
 
-    items.Add(pick(it));
+// ---------------- Virtual mode ----------------
+void IconGalleryCtrl::SetProvider(GalleryProvider *p) {
+    DoRemoveAll();
+    if(!p) return;
+    sort_by = SORT_NONE; // orders and hides need every item
+    sort_desc = hide_filtered = false;
+    filter_text.Clear();
+    items.SetProvider(p);
+    selection.SetCount(items.GetCount());
+    filtered.SetCount(items.GetCount());
     Reflow(); Refresh();
-    return items.GetCount() - 1;
 }
 
-void IconGalleryCtrl::AddDummy(const String& name) { Add(name); }
+void IconGalleryCtrl::ProviderChanged() {
+    if(!IsVirtual()) return;
+    CancelThumbs();
+    ClearComposites();
+    items.SetProvider(items.GetProvider()); // drops every cached row, re-reads the count
+    selection.SetCount(items.GetCount());
+    filtered.SetCount(items.GetCount());
+    if(hover_index >= items.GetCount()) hover_index = -1;
+    if(anchor_index >= items.GetCount()) anchor_index = -1;
+    Reflow(); Refresh();
+}
+
+void IconGalleryCtrl::ProviderItemChanged(int index) {
+    if(!IsVirtual() || index < 0 || index >= items.GetCount()) return;
+    items.Invalidate(index); // re-fetched with a fresh revision, so composites and jobs go stale
+    for(int zi = 0; zi < zoom_steps.GetCount(); ++zi) {
+        int q = composites.Find(((int64)zi << 32) | index);
+        if(q >= 0) composites[q].rev = -1; // the caption too
+    }
+    Refresh(ItemRect(index));
+}
 
 // ---------------- Attach / clear real image ----------------
 bool IconGalleryCtrl::SetThumbFromFile(int index, const String& filepath) {
-    if(index < 0 || index >= items.GetCount()) return false;
+    if(IsVirtual() || index < 0 || index >= items.GetCount()) return false;
+    int tile = zoom_steps[zoom_i];
+    if(disk_cache) { // warm start: the pre-scaled thumb is all we need
+        Image thumb = disk_cache->Get(filepath, tile, ThumbVariant());
+        if(!thumb.IsEmpty()) { SetFileThumb(index, filepath, thumb); return true; }
+    }
     Image m = StreamRaster::LoadFileAny(filepath);
     if(IsNull(m)) { SetThumbStatus(index, ThumbStatus::Missing); return false; }
+    if(disk_cache) { // the file can be re-read later, so the full-size src is not kept
+        Image thumb = ResampleThumb(m, tile, thumb_fit, thumb_quality);
+        disk_cache->Put(filepath, tile, thumb, ThumbVariant());
+        SetFileThumb(index, filepath, thumb);
+        return true;
+    }
     SetThumbImage(index, m);
+    items.PayloadAdd(index).src_path = filepath; // so the budget may drop src and re-read the file
+    ThumbsGrown((int64)m.GetLength() * sizeof(RGBA));
     return true;
 }
 
+void IconGalleryCtrl::LoadThumbAsync(int index, const String& filepath) {
+    if(IsVirtual() || index < 0 || index >= items.GetCount()) return;
+    GalleryPayload& p = items.PayloadAdd(index);
+    p.src = Image();
+    p.src_path = filepath;
+    ClearMips(p);
+    items.SetLibRecord(index, -1);
+    items.SetStatus(index, ThumbStatus::Placeholder);
+    if(!items.IsLoading(index)) loading_count++;
+    items.SetFlag(index, GalleryItemStore::LOADING, true);
+    items.Touch(index);
+    StatusChanged(index);
+    Refresh(ItemRect(index));
+}
+
+void IconGalleryCtrl::EndLoad(int i) {
+    if(!items.IsLoading(i)) return;
+    items.SetFlag(i, GalleryItemStore::LOADING, false);
+    loading_count--;
+}
+
+void IconGalleryCtrl::SetFileThumb(int index, const String& path, const Image& thumb) {
+    EndLoad(index);
+    GalleryPayload& p = items.PayloadAdd(index);
+    p.src = Image();
+    p.src_path = path;
+    ClearMips(p);
+    MipSlot(p, zoom_i).normal = thumb;
+    ThumbsGrown((int64)thumb.GetLength() * sizeof(RGBA));
+    items.SetLibRecord(index, -1);
+    items.SetStatus(index, ThumbStatus::Auto);
+    items.Touch(index);
+    StatusChanged(index);
+    Refresh();
+}
+
 void IconGalleryCtrl::SetThumbImage(int index, const Image& img) {
-    if(index < 0 || index >= items.GetCount()) return;
-    auto& it = items[index];
-    it.src = img;
-    it.status = ThumbStatus::Auto;
-    it.thumb_normal = Image();
-    it.thumb_gray   = Image();
+    if(IsVirtual() || index < 0 || index >= items.GetCount()) return;
+    EndLoad(index);
+    if(img.IsEmpty())
+        items.PayloadFree(index);
+    else {
+        GalleryPayload& p = items.PayloadAdd(index);
+        p.src = img;
+        p.src_path.Clear();
+        ClearMips(p);
+    }
+    items.SetLibRecord(index, -1);
+    items.SetStatus(index, ThumbStatus::Auto);
+    items.Touch(index);
+    StatusChanged(index);
     Refresh();
 }
 
 void IconGalleryCtrl::ClearThumbImage(int index) {
-    if(index < 0 || index >= items.GetCount()) return;
-    auto& it = items[index];
-    it.src = Image();
-    it.thumb_normal = Image();
-    it.thumb_gray   = Image();
+    if(IsVirtual() || index < 0 || index >= items.GetCount()) return;
+    EndLoad(index);
+    items.PayloadFree(index);
+    items.SetLibRecord(index, -1);
+    items.Touch(index);
     Refresh();
 }
 
 // ---------------- Status toggle ----------------
 void IconGalleryCtrl::SetThumbStatus(int index, ThumbStatus s) {
-    if(index < 0 || index >= items.GetCount()) return;
-    auto& it = items[index];
-    if(it.status == s) return;
-    it.status = s;
-    it.thumb_normal = Image();
-    it.thumb_gray   = Image();
+    if(IsVirtual() || index < 0 || index >= items.GetCount()) return;
+    if(items.GetStatus(index) == s) return;
+    items.SetStatus(index, s);
+    if(GalleryPayload *p = items.GetPayload(index))
+        ClearMips(*p);
+    items.Touch(index);
+    StatusChanged(index);
     Refresh();
 }
 
 // ---------------- Selection helpers ----------------
 Vector<int> IconGalleryCtrl::GetSelection() const {
     Vector<int> out;
-    for(int i = 0; i < items.GetCount(); ++i)
-        if(items[i].selected) out.Add(i);
+    out.Reserve(selection.GetSetCount());
+    selection.ForEach([&](int i) { out.Add(i); });
     return out;
 }
 
+void IconGalleryCtrl::Select(int i, bool b) {
+    if(i < 0 || i >= items.GetCount() || selection[i] == b) return;
+    SelectItem(i, b);
+    Refresh(ItemRect(i));
+    NotifySelection();
+}
+
+// a, b are display slots
 void IconGalleryCtrl::SelectRange(int a, int b, bool additive) {
     if(a > b) Swap(a, b);
-    if(!additive) for(auto& it : items) it.selected = false;
-    for(int i = a; i <= b && i < items.GetCount(); ++i)
-        items[i].selected = true;
+    b = min(b, ViewCount() - 1);
+    if(!additive) {
+        selection.Zero();
+        NoteSelection(GallerySelectionChange::UNSELECT, 0, items.GetCount() - 1);
+    }
+    if(view_identity) { // slots are items: word-wise range set
+        selection.SetRange(a, b + 1, true);
+        NoteSelection(GallerySelectionChange::SELECT, a, b);
+    }
+    else
+        for(int slot = a; slot <= b; ++slot)
+            SelectItem(ViewAt(slot), true);
+}
+
+// Selection of the tiles in view; RefreshSelection then invalidates just the ones that flipped
+Vector<bool> IconGalleryCtrl::SnapSelection() const {
+    int first, last;
+    VisibleSlots(first, last);
+    Vector<bool> sel;
+    for(int slot = first; slot <= last; ++slot)
+        sel.Add(selection[ViewAt(slot)]);
+    return sel;
+}
+
+void IconGalleryCtrl::RefreshSelection(const Vector<bool>& before) {
+    int first, last;
+    VisibleSlots(first, last);
+    for(int slot = first; slot <= last && slot - first < before.GetCount(); ++slot)
+        if(selection[ViewAt(slot)] != before[slot - first])
+            Refresh(IndexRect(slot));
+}
+
+void IconGalleryCtrl::SelectItem(int i, bool b) {
+    if(selection[i] == b) return;
+    selection.Set(i, b);
+    NoteSelection(b ? GallerySelectionChange::SELECT : GallerySelectionChange::UNSELECT, i, i);
+}
+
+// Records a change for WhenSelectionDelta, extending the previous entry when it continues it
+void IconGalleryCtrl::NoteSelection(int op, int first, int last) {
+    if(first > last) return;
+    if(sel_delta.GetCount()) {
+        GallerySelectionChange& t = sel_delta.Top();
+        if(t.op == op && t.last + 1 == first) { t.last = last; return; }
+    }
+    GallerySelectionChange& c = sel_delta.Add();
+    c.op    = op;
+    c.first = first;
+    c.last  = last;
+}
+
+void IconGalleryCtrl::NotifySelection() {
+    if(WhenSelectionDelta && sel_delta.GetCount()) WhenSelectionDelta(sel_delta);
+    sel_delta.Clear();
+    if(WhenSelection) WhenSelection();
 }
 
 // ---------------- Filtering ----------------
 void IconGalleryCtrl::SetFiltered(int index, bool filtered_out) {
-    if(index < 0 || index >= items.GetCount()) return;
-    items[index].filtered_out = filtered_out;
+    if(index < 0 || index >= items.GetCount() || filtered[index] == filtered_out) return;
+    filtered.Set(index, filtered_out);
+    if(hide_filtered) ViewChanged();
     Refresh();
 }
 
 void IconGalleryCtrl::ClearFilterFlags() {
-    for(auto& it : items) it.filtered_out = false;
+    filter_text.Clear();
+    filtered.Zero();
+    if(hide_filtered) ViewChanged();
     Refresh();
 }
 
+void IconGalleryCtrl::SetFilterText(const String& text) {
+    if(IsVirtual() || text == filter_text) return;
+    filter_text = text;
+    ApplyFilterText();
+}
+
+// Writes the query result into the filter bits in bulk: all out, then matches back in
+void IconGalleryCtrl::ApplyFilterText() {
+    if(IsNull(filter_text))
+        filtered.Zero();
+    else {
+        filtered.SetRange(0, items.GetCount(), true);
+        for(int i : search.Query(filter_text))
+            filtered.Set(i, false);
+    }
+    if(hide_filtered) ViewChanged();
+    Refresh();
+}
+
+void IconGalleryCtrl::SetTags(int index, const String& tags) {
+    if(IsVirtual() || index < 0 || index >= items.GetCount()) return;
+    search.Set(index, items.GetName(index), tags);
+    if(!IsNull(filter_text))
+        SetFiltered(index, !search.Matches(index, filter_text));
+}
+
 // ---------------- Zoom ----------------
 void IconGalleryCtrl::SetZoomIndex(int zi) {
     zi = ClampInt(zi, 0, zoom_steps.GetCount() - 1);
     if(zi == zoom_i) return;
     zoom_i = zi;
     if(WhenZoom) WhenZoom(zoom_i);
-    for(auto& it : items) { it.thumb_normal = Image(); it.thumb_gray = Image(); }
+    CancelThumbs(); // cached levels are kept; only in-flight jobs are for the old size
+    items.ClearFlag(GalleryItemStore::QUEUED);
     Reflow(); Refresh();
 }
 
 // ---------------- Layout / Scrollbars sync ----------------
 void IconGalleryCtrl::Reflow() {
+    int64 t0 = instrument ? usecs() : 0;
+    if(view_dirty) RebuildView();
     Size sz  = GetSize();
     int tile = zoom_steps[zoom_i];
     int boxW = tile + 2*pad;
@@ -121,7 +355,7 @@ void IconGalleryCtrl::Reflow() {
 
     cols = max(1, (sz.cx - pad) / (boxW + pad));
 
-    int rows = items.GetCount() ? ((items.GetCount() - 1) / cols + 1) : 0;
+    int rows = ViewCount() ? ((ViewCount() - 1) / cols + 1) : 0;
     content_h = pad + rows * (boxH + pad);
 
     int max_scroll = max(0, content_h - sz.cy);
@@ -129,203 +363,376 @@ void IconGalleryCtrl::Reflow() {
 
     // Tell ScrollBars: pos/page/total
     sb.Set(Point(0, scroll_y), sz, Size(sz.cx, content_h));
+    if(instrument) acc.layout_us += usecs() - t0;
+}
+
+// Follows the scrollbar: what is already on screen is blitted, only the exposed rows get painted
+void IconGalleryCtrl::SyncScroll() {
+    int y = sb.GetY();
+    if(y == scroll_y) return;
+    int dy = scroll_y - y;
+    scroll_y = y;
+    ScrollView(0, dy);
+    if(show_hud) { // the overlay stays put while the content moves
+        Refresh(HudRect());
+        Refresh(HudRect().Offseted(0, dy));
+    }
+}
+
+void IconGalleryCtrl::VisibleSlots(int& first, int& last) const {
+    int boxH = zoom_steps[zoom_i] + labelH + 2*pad;
+    first = max(0, (scroll_y - pad) / (boxH + pad)) * cols;
+    last  = min(((scroll_y + GetSize().cy - pad) / (boxH + pad) + 1) * cols, ViewCount()) - 1;
 }
 
-Rect IconGalleryCtrl::IndexRectNoScroll(int i) const {
+// Geometry is per display slot; see ItemRect for item indices
+Rect IconGalleryCtrl::IndexRectNoScroll(int slot) const {
     int tile = zoom_steps[zoom_i];
     int boxW = tile + 2*pad;
     int boxH = tile + labelH + 2*pad;
-    int r = i / cols, c = i % cols;
+    int r = slot / cols, c = slot % cols;
     int x = pad + c * (boxW + pad);
     int y = pad + r * (boxH + pad);
     return RectC(x, y, boxW, boxH);
 }
 
-Rect IconGalleryCtrl::IndexRect(int i) const {
-    Rect raw = IndexRectNoScroll(i);
+Rect IconGalleryCtrl::IndexRect(int slot) const {
+    Rect raw = IndexRectNoScroll(slot);
     return RectC(raw.left, raw.top - scroll_y, raw.Width(), raw.Height());
 }
 
-// ---------------- Glyph builders ----------------
-Image IconGalleryCtrl::MakePlaceholderGlyph(int tile, bool gray) {
-    ImageBuffer ib(tile, tile);
-    RGBA* p = ib.Begin();
-    for(int i = 0; i < tile * tile; ++i, ++p) { p->r = p->g = p->b = 0; p->a = 255; }
-    ib.End();
-    BufferPainter bp(ib);
-    Color a = Color(24,28,34), b = Color(18,22,27);
-    int step = 8;
-    for(int y = 0; y < tile; y += step)
-        for(int x = 0; x < tile; x += step)
-            bp.Rectangle(x, y, step, step).Fill(((x + y) / step) % 2 ? a : b);
-    IconGalleryCtrl().DrawPlaceholderGlyph(bp, tile, gray);
-    return ib;
-}
-
-Image IconGalleryCtrl::MakeMissingGlyph(int tile, bool gray) {
-    ImageBuffer ib(tile, tile);
-    RGBA* p = ib.Begin();
-    for(int i = 0; i < tile * tile; ++i, ++p) { p->r = p->g = p->b = 0; p->a = 255; }
-    ib.End();
-    BufferPainter bp(ib);
-    Color a = Color(24,28,34), b = Color(18,22,27);
-    int step = 8;
-    for(int y = 0; y < tile; y += step)
-        for(int x = 0; x < tile; x += step)
-            bp.Rectangle(x, y, step, step).Fill(((x + y) / step) % 2 ? a : b);
-    IconGalleryCtrl().DrawMissingGlyph(bp, tile, gray);
-    return ib;
+Rect IconGalleryCtrl::ItemRect(int i) const {
+    int slot = SlotOf(i);
+    return slot >= 0 ? IndexRect(slot) : Rect(0, 0, 0, 0);
+}
+
+// ---------------- Hit-testing ----------------
+int IconGalleryCtrl::GetIndexAt(Point p) const {
+    int slot = SlotAt(p);
+    return slot >= 0 ? ViewAt(slot) : -1;
+}
+
+int IconGalleryCtrl::SlotAt(Point p) const {
+    int tile  = zoom_steps[zoom_i];
+    int boxW  = tile + 2*pad;
+    int boxH  = tile + labelH + 2*pad;
+    int x = p.x - pad;
+    int y = p.y + scroll_y - pad;
+    if(x < 0 || y < 0) return -1;
+    int c = x / (boxW + pad), r = y / (boxH + pad);
+    if(c >= cols || x % (boxW + pad) >= boxW || y % (boxH + pad) >= boxH) return -1; // in a gap
+    int slot = r * cols + c;
+    return slot < ViewCount() ? slot : -1;
+}
+
+// Half-open range of grid cells (x = column, y = row) whose tiles intersect a content rect
+Rect IconGalleryCtrl::CellRange(const Rect& content) const {
+    int tile  = zoom_steps[zoom_i];
+    int boxW  = tile + 2*pad;
+    int boxH  = tile + labelH + 2*pad;
+    int rows  = ViewCount() ? (ViewCount() - 1) / cols + 1 : 0;
+    Rect cr;
+    cr.left   = max(0,    FloorDiv(content.left - pad - boxW, boxW + pad) + 1);
+    cr.right  = min(cols, FloorDiv(content.right - pad - 1, boxW + pad) + 1);
+    cr.top    = max(0,    FloorDiv(content.top - pad - boxH, boxH + pad) + 1);
+    cr.bottom = min(rows, FloorDiv(content.bottom - pad - 1, boxH + pad) + 1);
+    if(cr.left >= cr.right || cr.top >= cr.bottom) return Rect(0, 0, 0, 0);
+    return cr;
 }
 
+Vector<int> IconGalleryCtrl::GetItemsInRect(const Rect& r) const {
+    Vector<int> out;
+    Rect cr = CellRange(r.Offseted(0, scroll_y));
+    for(int row = cr.top; row < cr.bottom; ++row)
+        for(int c = cr.left; c < cr.right; ++c) {
+            int slot = row * cols + c;
+            if(slot >= ViewCount()) break;
+            out.Add(ViewAt(slot));
+        }
+    return out;
+}
+
+// ---------------- Glyph builders ----------------
 const Image& IconGalleryCtrl::PlaceholderGlyph(int tile) {
-    static VectorMap<int, Image> cache;
-    int i = cache.Find(tile);
-    if(i < 0) { cache.Add(tile, MakePlaceholderGlyph(tile, false)); i = cache.Find(tile); }
-    return cache[i];
+    return GalleryTileAtlas::Get(ThumbStatus::Placeholder, tile, false);
 }
 const Image& IconGalleryCtrl::MissingGlyph(int tile) {
-    static VectorMap<int, Image> cache;
-    int i = cache.Find(tile);
-    if(i < 0) { cache.Add(tile, MakeMissingGlyph(tile, false)); i = cache.Find(tile); }
-    return cache[i];
-}
-
-// Internal primitive draws
-void IconGalleryCtrl::DrawPlaceholderGlyph(BufferPainter& p, int tile, bool gray) const {
-    Color edge = gray ? SColorDisabled() : SColorText();
-    int   m    = max(2, tile / 10);
-    int   t    = max(1, tile / 16);
-    int dash = max(2, tile / 12);
-    int gap  = dash;
-
-    for(int x = m; x < tile - m; x += dash + gap) {
-        int w = min(dash, tile - m - x);
-        p.Rectangle(x, m, w, t).Fill(edge);
-        p.Rectangle(x, tile - m - t, w, t).Fill(edge);
+    return GalleryTileAtlas::Get(ThumbStatus::Missing, tile, false);
+}
+
+// ---------------- Thumbnail rendering (runs on worker threads) ----------------
+// Only src-backed items get here; status glyphs and Auto dummies come from GalleryTileAtlas
+void IconGalleryCtrl::RenderThumbs(const ThumbJob& job, ThumbResult& r) {
+    int tile = job.tile;
+    int64 t0 = job.timed ? usecs() : 0;
+    Image scaled;
+    int variant = ::ThumbVariant(job.fit, job.quality);
+    if(job.src.IsEmpty() && job.rec >= 0 && variant == 0) // library item: pre-scaled thumb straight from the mapping
+        scaled = job.lib->GetThumb(job.rec, tile);
+    else
+    if(job.src.IsEmpty() && job.disk) // file-backed: pre-scaled thumb straight from the pack
+        scaled = job.disk->Get(job.path, tile, variant);
+    if(scaled.IsEmpty()) {
+        Image src = !job.src.IsEmpty() ? job.src
+                  : job.rec >= 0     ? job.lib->GetSource(job.rec)
+                  : job.provider     ? job.provider->GetThumb(job.index, tile)
+                  :                    StreamRaster::LoadFileAny(job.path);
+        if(job.timed) { int64 t = usecs(); r.decode_us = int(t - t0); t0 = t; }
+        if(IsNull(src)) { r.failed = true; return; }
+        scaled = ResampleThumb(src, tile, job.fit, job.quality);
+        if(job.disk && job.need_normal && !IsNull(job.path))
+            job.disk->Put(job.path, tile, scaled, variant);
+        if(job.timed) { int64 t = usecs(); r.scale_us = int(t - t0); t0 = t; }
     }
-    for(int y = m; y < tile - m; y += dash + gap) {
-        int h = min(dash, tile - m - y);
-        p.Rectangle(m, y, t, h).Fill(edge);
-        p.Rectangle(tile - m - t, y, t, h).Fill(edge);
+    else
+    if(job.timed) { int64 t = usecs(); r.decode_us = int(t - t0); t0 = t; }
+    if(job.need_normal) r.normal = scaled;
+
+    if(job.need_gray) {
+        r.gray = DesaturateImage(scaled);
+        if(job.timed) r.gray_us = int(usecs() - t0);
     }
-    int cx = tile / 2, cy = tile / 2, arm = (tile - 2*m) / 3;
-    p.Rectangle(cx - t/2, cy - arm, t, 2*arm).Fill(edge);
-    p.Rectangle(cx - arm, cy - t/2, 2*arm, t).Fill(edge);
 }
 
-void IconGalleryCtrl::DrawMissingGlyph(BufferPainter& p, int tile, bool gray) const {
-    const Color warn = gray ? SColorDisabled() : Color(200, 60, 60);
-    const int   m    = max(2, tile / 10);
-    const int   t    = max(2, tile / 14);
+// ---------------- Background thumbnail queue ----------------
+const ThumbMip* IconGalleryCtrl::FindMip(const GalleryPayload& p, int zi) {
+    for(const ThumbMip& m : p.mip)
+        if(m.zi == zi) return &m;
+    return nullptr;
+}
 
-    p.Rectangle(m, m,                tile - 2*m, t          ).Fill(warn);
-    p.Rectangle(m, tile - m - t,     tile - 2*m, t          ).Fill(warn);
-    p.Rectangle(m, m,                t,          tile - 2*m ).Fill(warn);
-    p.Rectangle(tile - m - t, m,     t,          tile - 2*m ).Fill(warn);
+ThumbMip* IconGalleryCtrl::FindMip(GalleryPayload& p, int zi) {
+    for(ThumbMip& m : p.mip)
+        if(m.zi == zi) return &m;
+    return nullptr;
+}
 
-    const int cx   = tile / 2;
-    const int barh = (tile - 2*m) * 2 / 3;
-    const int dot  = max(2, t);
+// Slot for level zi: the existing one, else a free or the least recently used slot
+ThumbMip& IconGalleryCtrl::MipSlot(GalleryPayload& p, int zi) {
+    ThumbMip* lru = &p.mip[0];
+    for(ThumbMip& m : p.mip) {
+        if(m.zi == zi) return m;
+        if(m.zi < 0 || (lru->zi >= 0 && m.stamp < lru->stamp)) lru = &m;
+    }
+    lru->zi = zi;
+    lru->normal = lru->gray = Image();
+    return *lru;
+}
 
-    p.Rectangle(cx - t/2,
-                m + (tile - 2*m - barh)/2,
-                t,
-                barh - 2*dot).Fill(warn);
+void IconGalleryCtrl::ClearMips(GalleryPayload& p) {
+    for(ThumbMip& m : p.mip) { m.zi = -1; m.normal = m.gray = Image(); }
+}
 
-    p.Rectangle(cx - dot/2,
-                m + (tile - 2*m - dot)/2 + barh - dot,
-                dot,
-                dot).Fill(warn);
+bool IconGalleryCtrl::ThumbReady(int i, bool want_gray) const {
+    if(!items.HasImage(i)) return true; // atlas tile
+    const GalleryPayload *p = items.GetPayload(i); // none yet: library item not shown so far
+    const ThumbMip* m = p ? FindMip(*p, zoom_i) : nullptr;
+    return m && !m->normal.IsEmpty() && (!want_gray || !m->gray.IsEmpty());
 }
 
-// ---------------- Ensure thumbs at current zoom ----------------
-void IconGalleryCtrl::EnsureThumbs(IconGalleryItem& it) {
-    int tile = zoom_steps[zoom_i];
-    bool need_normal = it.thumb_normal.IsEmpty()
-                    || it.thumb_normal.GetWidth() != tile
-                    || it.thumb_normal.GetHeight() != tile;
-    bool need_gray   = it.thumb_gray.IsEmpty()
-                    || it.thumb_gray.GetWidth() != tile
-                    || it.thumb_gray.GetHeight() != tile;
-    if(!need_normal && !need_gray) return;
-
-    if(!it.src.IsEmpty()) {
-        Image scaled = Rescale(it.src, Size(tile, tile));
-        if(need_normal) it.thumb_normal = scaled;
-
-        if(need_gray) {
-            ImageBuffer gb(tile, tile);
-            const RGBA* sp = scaled.Begin();
-            RGBA*       gp = gb.Begin();
-            for(int i = 0; i < tile * tile; ++i, ++sp, ++gp) {
-                int lum = (sp->r*30 + sp->g*59 + sp->b*11) / 100;
-                gp->r = gp->g = gp->b = (byte)lum;
-                gp->a = sp->a;
+// Replaces the pending queue with the tiles of the current viewport and its neighbours.
+// Anything queued earlier that is no longer inside [first, last] has scrolled away and is
+// cancelled.
+void IconGalleryCtrl::QueueThumbs(const Vector<int>& want, int first, int last) {
+    vis_first = first;
+    vis_last  = last;
+
+    int tile  = zoom_steps[zoom_i];
+    int epoch = thumb_epoch;
+    Vector<int> dropped;
+    int spawn = 0;
+    {
+        Mutex::Lock __(thumb_lock);
+        Vector<ThumbJob> keep;
+        for(ThumbJob& job : thumb_queue) {
+            job.slot = SlotOf(job.index); // the view may have been re-sorted since
+            if(job.epoch == epoch && job.slot >= first && job.slot <= last)
+                keep.Add(pick(job));
+            else
+                dropped.Add(job.index);
+        }
+        thumb_queue = pick(keep);
+
+        for(int i : want) {
+            const GalleryPayload& p = items.PayloadAdd(i); // only image-backed items are queued
+            const ThumbMip* m = FindMip(p, zoom_i);
+            ThumbJob& job = thumb_queue.Add();
+            job.index  = i;
+            job.slot   = SlotOf(i);
+            job.epoch  = epoch;
+            job.rev    = items.GetRev(i);
+            job.zi     = zoom_i;
+            job.tile   = tile;
+            job.need_normal = !m || m->normal.IsEmpty();
+            job.need_gray   = WantGray(i) && (!m || m->gray.IsEmpty());
+            // Derive from the nearest larger cached level instead of the full-size source
+            job.src  = job.need_normal ? p.src : m->normal;
+            job.path = p.src_path;
+            job.disk = disk_cache;
+            job.lib  = items.GetLibrary();
+            job.rec  = items.GetLibRecord(i);
+            job.provider = items.GetProvider();
+            job.fit     = thumb_fit;
+            job.quality = thumb_quality;
+            job.timed = instrument;
+            if(job.need_normal) {
+                int best = INT_MAX;
+                for(const ThumbMip& l : p.mip)
+                    if(l.zi > zoom_i && l.zi < best && !l.normal.IsEmpty()) {
+                        best = l.zi;
+                        job.src = l.normal;
+                    }
             }
-            gb.End();
-            it.thumb_gray = gb;
+            job.io = job.src.IsEmpty();
         }
-        return;
-    }
 
-    // No src: draw status glyphs (or auto dummy)
-    if(need_normal) {
-        switch(it.status) {
-        case ThumbStatus::Placeholder: it.thumb_normal = MakePlaceholderGlyph(tile, false); break;
-        case ThumbStatus::Missing:     it.thumb_normal = MakeMissingGlyph(tile, false);     break;
-        case ThumbStatus::Auto: {
-            ImageBuffer ib(tile, tile);
-            RGBA* p = ib.Begin();
-            for(int i = 0; i < tile * tile; ++i, ++p) { p->r = p->g = p->b = 0; p->a = 255; }
-            ib.End();
-            BufferPainter bp(ib);
-            Color a = Color(24,28,34), b = Color(18,22,27);
-            int step = 8;
-            for(int y = 0; y < tile; y += step)
-                for(int x = 0; x < tile; x += step)
-                    bp.Rectangle(x, y, step, step).Fill(((x + y) / step) % 2 ? a : b);
-            int m = max(2, tile / 8);
-            bp.Rectangle(m, m, tile - 2*m, tile - 2*m).Fill(it.seed);
-            it.thumb_normal = ib;
-            break;
-        }}
+        int max_workers = max(1, CPU_Cores() - 1);
+        spawn = min(thumb_queue.GetCount(), max_workers) - thumb_workers;
+        if(spawn > 0) thumb_workers += spawn;
     }
 
-    if(need_gray) {
-        switch(it.status) {
-        case ThumbStatus::Placeholder: it.thumb_gray = MakePlaceholderGlyph(tile, true); break;
-        case ThumbStatus::Missing:     it.thumb_gray = MakeMissingGlyph(tile, true);     break;
-        case ThumbStatus::Auto: {
-            ImageBuffer gb(tile, tile);
-            RGBA* gp = gb.Begin();
-            for(int i = 0; i < tile * tile; ++i, ++gp) { gp->r = gp->g = gp->b = 0; gp->a = 255; }
-            gb.End();
-            BufferPainter gpb(gb);
-            Color a = Color(24,28,34), b = Color(18,22,27);
-            int step = 8;
-            for(int y = 0; y < tile; y += step)
-                for(int x = 0; x < tile; x += step)
-                    gpb.Rectangle(x, y, step, step).Fill(((x + y) / step) % 2 ? a : b);
-            int m = max(2, tile / 8);
-            int lum = (it.seed.GetR()*30 + it.seed.GetG()*59 + it.seed.GetB()*11)/100;
-            Color gray(lum, lum, lum);
-            gpb.Rectangle(m, m, tile - 2*m, tile - 2*m).Fill(gray);
-            it.thumb_gray = gb;
-            break;
-        }}
+    for(int i : want) items.SetFlag(i, GalleryItemStore::QUEUED, true);
+    for(int i : dropped)
+        if(i < items.GetCount()) items.SetFlag(i, GalleryItemStore::QUEUED, false);
+
+    for(int n = 0; n < spawn; ++n)
+        thumb_work & [=] { ThumbWorker(); };
+
+    if((spawn > 0 || want.GetCount()) && !ExistsTimeCallback(TIMEID_THUMBS))
+        SetTimeCallback(-15, [=] { DrainThumbs(); }, TIMEID_THUMBS);
+}
+
+bool IconGalleryCtrl::IsThumbWorkPending() const {
+    Mutex::Lock __(thumb_lock);
+    return thumb_queue.GetCount() || thumb_done.GetCount() || thumb_workers;
+}
+
+void IconGalleryCtrl::CancelThumbs() {
+    thumb_epoch++;
+    Mutex::Lock __(thumb_lock);
+    thumb_queue.Clear();
+    thumb_done.Clear();
+}
+
+// Every cached level of every image-backed item is rebuilt on next show
+void IconGalleryCtrl::ResetThumbs() {
+    if(IsVirtual()) { ProviderChanged(); return; }
+    CancelThumbs();
+    items.ClearFlag(GalleryItemStore::QUEUED);
+    for(int i = 0; i < items.GetCount(); ++i)
+        if(GalleryPayload *p = items.GetPayload(i)) {
+            ClearMips(*p);
+            items.Touch(i);
+        }
+    Refresh();
+}
+
+void IconGalleryCtrl::SetThumbFit(ThumbFit f) {
+    if(f == thumb_fit) return;
+    thumb_fit = f;
+    ResetThumbs();
+}
+
+void IconGalleryCtrl::SetThumbQuality(ResampleQuality q) {
+    if(q == thumb_quality) return;
+    thumb_quality = q;
+    ResetThumbs();
+}
+
+void IconGalleryCtrl::ThumbWorker() {
+    for(;;) {
+        ThumbJob job;
+        {
+            Mutex::Lock __(thumb_lock);
+            // First job in priority order that fits; file loads are capped at max_io so
+            // decodes cannot starve rescaling of already loaded sources.
+            int q = -1;
+            for(int i = 0; i < thumb_queue.GetCount() && q < 0; ++i)
+                if(!thumb_queue[i].io || thumb_io < max_io) q = i;
+            if(q < 0) { thumb_workers--; return; } // only loads left; the I/O workers take them
+            job = pick(thumb_queue[q]);
+            thumb_queue.Remove(q);
+            if(job.io) thumb_io++;
+        }
+
+        ThumbResult r;
+        r.index = job.index;
+        r.epoch = job.epoch;
+        r.rev   = job.rev;
+        r.zi    = job.zi;
+        // A zoom step or a scroll may have happened since the job was queued
+        if(job.epoch == thumb_epoch && job.slot >= vis_first && job.slot <= vis_last) {
+            RenderThumbs(job, r);
+            r.done = true;
+        }
+
+        Mutex::Lock __(thumb_lock);
+        if(job.io) thumb_io--;
+        thumb_done.Add(pick(r));
     }
 }
 
-// ---------------- Paint & input ----------------
-Color IconGalleryCtrl::AutoColorFromText(const String& s) const {
-    unsigned acc = 0;
-    for(byte ch : s) acc = acc * 131 + ch;
-    double h  = (acc % 360) / 360.0;
-    double sN = 0.45 + ((acc % 60) / 60.0) * 0.25;
-    double vN = 0.55 + (((acc / 7) % 50) / 50.0) * 0.25;
-    return HsvColorf(h, sN, vN);
+// GUI-side timer: applies finished thumbs and refreshes just the tiles that changed
+void IconGalleryCtrl::DrainThumbs() {
+    Vector<ThumbResult> done;
+    bool idle;
+    {
+        Mutex::Lock __(thumb_lock);
+        done = pick(thumb_done);
+        idle = thumb_queue.IsEmpty() && thumb_workers == 0;
+    }
+
+    int epoch = thumb_epoch;
+    int64 grown = 0;
+    BeginUpdate(); // status moves of the whole batch are re-sorted by one Reflow
+    for(ThumbResult& r : done) {
+        if(r.epoch != epoch || r.index >= items.GetCount()) continue;
+        int i = r.index;
+        if(!items.IsCached(i) && (i < vis_first || i > vis_last))
+            continue; // virtual row trimmed while queued: touching it would fetch it back
+        items.SetFlag(i, GalleryItemStore::QUEUED, false);
+        if(instrument) {
+            acc.thumbs_done   += r.done && !r.failed;
+            acc.thumbs_failed += r.failed;
+            acc.decode_us     += r.decode_us;
+            acc.scale_us      += r.scale_us;
+            acc.gray_us       += r.gray_us;
+        }
+        if(r.failed && r.rev == items.GetRev(i)) { // same outcome as a failed SetThumbFromFile
+            EndLoad(i);
+            items.PayloadFree(i);
+            items.SetLibRecord(i, -1);
+            items.SetStatus(i, ThumbStatus::Missing);
+            items.Touch(i);
+            StatusChanged(i);
+        }
+        else
+        if(r.done && r.rev == items.GetRev(i)) { // same revision: the payload is still there
+            if(items.IsLoading(i)) {
+                EndLoad(i);
+                items.SetStatus(i, ThumbStatus::Auto);
+                StatusChanged(i);
+            }
+            ThumbMip& m = MipSlot(*items.GetPayload(i), r.zi);
+            m.stamp = paint_frame;
+            if(!r.normal.IsEmpty()) m.normal = r.normal;
+            if(!r.gray.IsEmpty())   m.gray   = r.gray;
+            grown += (int64)(r.normal.GetLength() + r.gray.GetLength()) * sizeof(RGBA);
+        }
+        else {
+            int slot = SlotOf(i);
+            if(slot < vis_first || slot > vis_last)
+                continue; // cancelled off-screen; it is queued again once scrolled back in
+        }
+        Refresh(ItemRect(i));
+    }
+    EndUpdate();
+
+    ThumbsGrown(grown);
+    if(idle) KillTimeCallback(TIMEID_THUMBS);
 }
 
+// ---------------- Paint & input ----------------
 void IconGalleryCtrl::StrokeRect(Draw& w, const Rect& r, int t, const Color& c) const {
     if(t <= 0) return;
     w.DrawRect(RectC(r.left, r.top, r.Width(), t), c);
@@ -334,14 +741,30 @@ void IconGalleryCtrl::StrokeRect(Draw& w, const Rect& r, int t, const Color& c)
     w.DrawRect(RectC(r.right - t, r.top, t, r.Height()), c);
 }
 
+// Only tiles inside the paint (damage) rect are drawn; the pass over the rows in view that
+// finds missing thumbs looks at flags only.
 void IconGalleryCtrl::Paint(Draw& w) {
+    int64 t_paint = instrument ? usecs() : 0;
     Size sz = GetSize();
-    w.DrawRect(sz, SColorPaper());
+    Rect clip = w.GetPaintRect() & Rect(sz);
+    bool hud_only = show_hud && HudRect().Contains(clip); // overlay refresh, not a frame
+    w.DrawRect(clip, SColorPaper());
 
     if(items.IsEmpty()) {
         w.DrawText(10, 10, "Gallery empty — use Save to add icons", StdFont(), SColorDisabled());
         return;
     }
+    if(!ViewCount()) {
+        w.DrawText(10, 10, "No icons match the filter", StdFont(), SColorDisabled());
+        return;
+    }
+
+    dword theme = CombineHash(SColorPaper(), SColorFace(), SColorLtFace(), SColorHighlight(),
+                              SColorText(), SColorDisabled(), SColorShadow(), StdFont());
+    if(theme != composite_theme) {
+        ClearComposites();
+        composite_theme = theme;
+    }
 
     Rect vr(0, 0, sz.cx, sz.cy);
     int tile = zoom_steps[zoom_i];
@@ -349,50 +772,152 @@ void IconGalleryCtrl::Paint(Draw& w) {
 
     int firstRow = max(0, (scroll_y - pad) / (boxH + pad));
     int lastRow  = (scroll_y + sz.cy - pad) / (boxH + pad) + 1;
+    Vector<int> want; // visible tiles without thumbs, in paint (= priority) order
+    paint_frame++;
+    int tiles = 0, thumb_hits = 0, thumb_misses = 0, hits = 0, misses = 0;
+    int64 compose_us = 0;
 
     for(int r = firstRow; r <= lastRow; ++r) {
         for(int c = 0; c < cols; ++c) {
-            int i = r * cols + c;
-            if(i >= items.GetCount()) break;
+            int slot = r * cols + c;
+            if(slot >= ViewCount()) break;
 
-            Rect box = IndexRect(i);
+            Rect box = IndexRect(slot);
             if(!box.Intersects(vr)) continue;
 
-            auto& it = items[i];
-            EnsureThumbs(it);
-
-            // base panel
-            w.DrawRect(box, Blend(SColorFace(), SColorPaper(), 200));
-
-            // hover tint (subtle)
-            if(i == hover_index && !it.selected) {
-                Color tint = Blend(SColorHighlight(), SColorFace(), 220);
-                w.DrawRect(box, tint);
+            int i = ViewAt(slot);
+            bool shared = !items.HasImage(i); // glyph / dummy tile from the atlas
+            // Library items get their payload here, the first time they are in view
+            GalleryPayload* pl = shared ? nullptr : &items.PayloadAdd(i);
+            ThumbMip* mip = pl ? FindMip(*pl, zoom_i) : nullptr;
+            if(pl) pl->seen = paint_frame;
+            const bool want_gray = WantGray(i);
+            bool ready = ThumbReady(i, want_gray);
+            if(!ready && !items.IsQueued(i)) want.Add(i);
+            if(!shared) (ready ? thumb_hits : thumb_misses)++;
+            if(mip) mip->stamp = paint_frame;
+            if(!box.Intersects(clip)) continue; // in view, but not damaged
+
+            // Everything that changes the look of a tile is in the variant bits
+            int variant = (want_gray ? TILE_GRAY : 0);
+            if(selection[i])
+                variant |= show_selection_border ? TILE_SELECTED : 0;
+            else
+            if(i == hover_index)
+                variant |= TILE_HOVER;
+            if(show_filter_border && !filtered[i])
+                variant |= TILE_FILTER_BORDER;
+
+            GalleryTileComposite& tc = Composite(i);
+            tc.stamp = paint_frame;
+            tiles++;
+            if(!ready) { // loading / stand-in tiles are short-lived, drawn directly
+                PaintTile(w, box, i, variant, tc.caption, mip);
+                continue;
             }
+            Image& img = tc.variant[variant];
+            if(img.IsEmpty()) {
+                int64 t0 = instrument ? usecs() : 0;
+                ImageDraw iw(box.GetSize());
+                PaintTile(iw, Rect(box.GetSize()), i, variant, tc.caption, mip);
+                img = iw;
+                if(instrument) compose_us += usecs() - t0;
+                misses++;
+            }
+            else
+                hits++;
+            w.DrawImage(box.left, box.top, img);
+        }
+    }
+
+    if(banding) {
+        Rect br = Rect(band_origin, band_cur).Normalized().Offseted(0, -scroll_y);
+        StrokeRect(w, br.Inflated(0, 0, 1, 1), 1, SColorHighlight());
+    }
+    int64 t_tiles = instrument ? usecs() : 0;
+
+    // Neighbours: one page below, then one page above the viewport
+    int page = lastRow - firstRow + 1;
+    auto neighbours = [&](int r0, int r1) {
+        for(int slot = max(0, r0 * cols); slot < min((r1 + 1) * cols, ViewCount()); ++slot) {
+            int i = ViewAt(slot);
+            if(!items.IsQueued(i) && !ThumbReady(i, WantGray(i))) want.Add(i);
+        }
+    };
+    neighbours(lastRow + 1, lastRow + page);
+    neighbours(firstRow - page, firstRow - 1);
+
+    int first = min(max(0, firstRow - page) * cols, ViewCount());
+    int last  = min((lastRow + page + 1) * cols, ViewCount()) - 1;
+    QueueThumbs(want, first, last);
+    TrimComposites(3 * (lastRow - firstRow + 1) * cols);
+    items.TrimVirtual(first, last, 2 * (last - first + 1)); // virtual: slots are items
+
+    if(instrument && !hud_only) {
+        int64 t = usecs();
+        acc.paint_us         = t - t_paint;
+        acc.tiles_us         = t_tiles - t_paint;
+        acc.queue_us         = t - t_tiles;
+        acc.compose_us       = compose_us;
+        acc.tiles            = tiles;
+        acc.thumb_hits       = thumb_hits;
+        acc.thumb_misses     = thumb_misses;
+        acc.composite_hits   = hits;
+        acc.composite_misses = misses;
+        PublishStats();
+    }
+    if(show_hud) {
+        PaintHud(w);
+        if(!hud_only && !clip.Contains(HudRect()))
+            Refresh(HudRect()); // partially damaged frame: bring the whole overlay up to date
+    }
+}
 
-            if(show_filter_border && !it.filtered_out)
-                StrokeRect(w, box, 1, SColorPaper());
+// One tile at box: panel, thumb (or its stand-in), caption and borders
+void IconGalleryCtrl::PaintTile(Draw& w, const Rect& box, int i, int variant, const String& caption,
+                                const ThumbMip* mip) const {
+    int tile = zoom_steps[zoom_i];
+    bool gray = variant & TILE_GRAY;
 
-            const bool want_gray = !saturation_on || it.filtered_out;
-            const Image& thumb = want_gray && !it.thumb_gray.IsEmpty()
-                               ? it.thumb_gray : it.thumb_normal;
+    // base panel
+    w.DrawRect(box, Blend(SColorFace(), SColorPaper(), 200));
 
-            Size ts = thumb.GetSize();
-            Point p = box.TopLeft() + Point((box.GetWidth() - ts.cx) / 2, pad);
-            w.DrawImage(p.x, p.y, thumb);
+    // hover tint (subtle)
+    if(variant & TILE_HOVER)
+        w.DrawRect(box, Blend(SColorHighlight(), SColorFace(), 220));
 
-            Rect lab = RectC(box.left, box.bottom - labelH - pad, box.GetWidth(), labelH + pad);
-            w.DrawRect(lab, SColorLtFace());
-            String caption = it.name;
-            if(caption.GetLength() > 24) caption = caption.Left(21) + "...";
-            const Color textc = (want_gray ? SColorDisabled() : SColorText());
-            w.DrawText(lab.left + 6, lab.top + (labelH - StdFont().GetHeight()) / 2,
-                       caption, StdFont(), textc);
+    if(variant & TILE_FILTER_BORDER)
+        StrokeRect(w, box, 1, SColorPaper());
 
-            if(show_selection_border && it.selected)
-                StrokeRect(w, box, 2, SColorHighlight());
+    Point p = box.TopLeft() + Point((box.GetWidth() - tile) / 2, pad);
+    if(!items.HasImage(i)) {
+        ThumbStatus status = items.GetStatus(i);
+        if(status == ThumbStatus::Auto) { // shared checker + one seed-colored fill
+            int m = max(2, tile / 8);
+            Color seed = items.GetSeed(i);
+            w.DrawImage(p.x, p.y, GalleryTileAtlas::Checker(tile));
+            w.DrawRect(p.x + m, p.y + m, tile - 2*m, tile - 2*m,
+                       gray ? GalleryTileAtlas::GrayOf(seed) : seed);
         }
+        else
+            w.DrawImage(p.x, p.y, GalleryTileAtlas::Get(status, tile, gray));
     }
+    else
+    if(ThumbReady(i, gray))
+        w.DrawImage(p.x, p.y, gray ? mip->gray : mip->normal);
+    else
+    if(items.IsLoading(i))
+        w.DrawImage(p.x, p.y, GalleryTileAtlas::Get(ThumbStatus::Placeholder, tile, gray));
+    else // cheap stand-in until the worker posts the real thumb
+        w.DrawRect(p.x, p.y, tile, tile, Blend(SColorFace(), SColorShadow(), 40));
+
+    Rect lab = RectC(box.left, box.bottom - labelH - pad, box.GetWidth(), labelH + pad);
+    w.DrawRect(lab, SColorLtFace());
+    w.DrawText(lab.left + CAPTION_MARGIN, lab.top + (labelH - StdFont().GetHeight()) / 2,
+               caption, StdFont(), gray ? SColorDisabled() : SColorText());
+
+    if(variant & TILE_SELECTED)
+        StrokeRect(w, box, 2, SColorHighlight());
 }
 
 void IconGalleryCtrl::LeftDown(Point p, dword flags) {
@@ -400,23 +925,100 @@ void IconGalleryCtrl::LeftDown(Point p, dword flags) {
     bool ctrl  = (flags & K_CTRL) != 0;
     bool shift = (flags & K_SHIFT) != 0;
 
-    for(int i = 0; i < items.GetCount(); ++i) if(IndexRect(i).Contains(p)) {
-        if(shift && anchor_index >= 0) {
-            SelectRange(anchor_index, i, ctrl); // ctrl keeps existing, otherwise replace
+    Vector<bool> before = SnapSelection();
+    int slot = SlotAt(p);
+    if(slot >= 0) {
+        int i = ViewAt(slot);
+        int anchor_slot = anchor_index >= 0 ? SlotOf(anchor_index) : -1;
+        if(shift && anchor_slot >= 0) {
+            SelectRange(anchor_slot, slot, ctrl); // ctrl keeps existing, otherwise replace
         } else {
-            if(!ctrl) for(auto& it : items) it.selected = false;
-            items[i].selected = ctrl ? !items[i].selected : true;
+            if(!ctrl) {
+                selection.Zero();
+                NoteSelection(GallerySelectionChange::UNSELECT, 0, items.GetCount() - 1);
+            }
+            if(ctrl) {
+                selection.Set(i, !selection[i]);
+                NoteSelection(GallerySelectionChange::TOGGLE, i, i);
+            }
+            else
+                SelectItem(i, true);
             anchor_index = i; // update anchor for future shift
         }
-        Refresh();
-        if(WhenSelection) WhenSelection();
+        RefreshSelection(before);
+        NotifySelection();
         return;
     }
+
+    // Empty space: start a rubber band
+    banding       = true;
+    band_additive = ctrl;
+    band_origin   = band_cur = p + Point(0, scroll_y);
+    band_cells    = Rect(0, 0, 0, 0);
+    if(ctrl)
+        band_base = clone(selection); // word copy, a few µs even for a million items
+    else {
+        band_base.SetCount(0);
+        selection.Zero();
+        NoteSelection(GallerySelectionChange::UNSELECT, 0, items.GetCount() - 1);
+    }
+    SetCapture();
+    RefreshSelection(before);
+}
+
+void IconGalleryCtrl::LeftUp(Point, dword) {
+    if(!banding) return;
+    RefreshBand();
+    banding = false;
+    band_base.SetCount(0);
+    ReleaseCapture();
+    NotifySelection();
+}
+
+// Just the outline of the band, as drawn by Paint
+void IconGalleryCtrl::RefreshBand() {
+    Rect br = Rect(band_origin, band_cur).Normalized().Offseted(0, -scroll_y).Inflated(0, 0, 1, 1);
+    Refresh(RectC(br.left, br.top, br.Width(), 1));
+    Refresh(RectC(br.left, br.bottom - 1, br.Width(), 1));
+    Refresh(RectC(br.left, br.top, 1, br.Height()));
+    Refresh(RectC(br.right - 1, br.top, 1, br.Height()));
+}
+
+// Only cells entering or leaving the band are touched, so a drag over tens of
+// thousands of tiles costs O(rows + changed cells) per mouse move.
+void IconGalleryCtrl::UpdateBand(Point p) {
+    if(p.y < 0 || p.y >= GetSize().cy) { // autoscroll while dragging past the edges
+        sb.SetY(scroll_y + (p.y < 0 ? p.y : p.y - GetSize().cy + 1));
+        SyncScroll();
+    }
+    Vector<bool> before = SnapSelection();
+    RefreshBand();
+    band_cur = p + Point(0, scroll_y);
+    Rect nc = CellRange(Rect(band_origin, band_cur).Normalized().Inflated(0, 0, 1, 1));
+
+    auto each_outside = [&](const Rect& a, const Rect& b, auto fn) {
+        for(int r = a.top; r < a.bottom; ++r) {
+            bool row_in = r >= b.top && r < b.bottom;
+            for(int c = a.left; c < a.right; ++c) {
+                if(row_in && c >= b.left && c < b.right) { c = b.right - 1; continue; }
+                int slot = r * cols + c;
+                if(slot >= ViewCount()) break;
+                fn(ViewAt(slot));
+            }
+        }
+    };
+    each_outside(band_cells, nc, [&](int i) {
+        SelectItem(i, band_additive && i < band_base.GetCount() && band_base[i]);
+    });
+    each_outside(nc, band_cells, [&](int i) { SelectItem(i, true); });
+    band_cells = nc;
+    RefreshBand();
+    RefreshSelection(before);
 }
 
 void IconGalleryCtrl::LeftDouble(Point p, dword) {
-    for(int i = 0; i < items.GetCount(); ++i)
-        if(IndexRect(i).Contains(p) && WhenActivate) { WhenActivate(items[i]); return; }
+    int i = GetIndexAt(p);
+    if(i >= 0 && WhenActivate) WhenActivate(GetItem(i));
 }
 
 void IconGalleryCtrl::RightDown(Point p, dword) {
@@ -424,23 +1026,25 @@ void IconGalleryCtrl::RightDown(Point p, dword) {
 }
 
 void IconGalleryCtrl::MouseMove(Point p, dword) {
-    int new_hover = -1;
-    for(int i = 0; i < items.GetCount(); ++i)
-        if(IndexRect(i).Contains(p)) { new_hover = i; break; }
-    if(new_hover != hover_index) { hover_index = new_hover; Refresh(); }
+    if(banding) { UpdateBand(p); return; }
+    int new_hover = GetIndexAt(p);
+    if(new_hover != hover_index) {
+        Refresh(ItemRect(hover_index));
+        hover_index = new_hover;
+        Refresh(ItemRect(hover_index));
+    }
 }
 
 bool IconGalleryCtrl::Key(dword key, int) {
     // Let ScrollBars handle page/home/end/arrows etc.
     if(sb.Key(key)) {
-        scroll_y = sb.GetY();
-        Refresh();
+        SyncScroll();
         return true;
     }
 
     if(key == K_ENTER) {
-        Vector<int> sel = GetSelection();
-        if(sel.GetCount() && WhenActivate) { WhenActivate(items[sel[0]]); return true; }
+        int i = GetFirstSelected();
+        if(i >= 0 && WhenActivate) { WhenActivate(GetItem(i)); return true; }
     }
     return false;
 }
@@ -448,8 +1052,7 @@ bool IconGalleryCtrl::Key(dword key, int) {
 void IconGalleryCtrl::MouseWheel(Point, int zdelta, dword keyflags) {
     if(keyflags & K_CTRL) { SetZoomIndex(zoom_i + (zdelta > 0 ? +1 : -1)); return; }
     sb.WheelY(zdelta);
-    scroll_y = sb.GetY();
-    Refresh();
+    SyncScroll();
 }
 
 // ---------------- Context menu ----------------
@@ -465,27 +1068,57 @@ void IconGalleryCtrl::ShowContextMenu(Point p) {
 }
 
 void IconGalleryCtrl::DoSelectAll() {
-    for(auto& it : items) it.selected = true;
-    Refresh(); if(WhenSelection) WhenSelection();
+    Vector<bool> before = SnapSelection();
+    selection.SetRange(0, items.GetCount(), true);
+    NoteSelection(GallerySelectionChange::SELECT, 0, items.GetCount() - 1);
+    RefreshSelection(before); NotifySelection();
 }
 void IconGalleryCtrl::DoInvertSelection() {
-    for(auto& it : items) it.selected = !it.selected;
-    Refresh(); if(WhenSelection) WhenSelection();
+    selection.Invert();
+    NoteSelection(GallerySelectionChange::TOGGLE, 0, items.GetCount() - 1);
+    Refresh(); NotifySelection(); // every tile in view flips
 }
 void IconGalleryCtrl::DoClearSelection() {
-    for(auto& it : items) it.selected = false;
-    Refresh(); if(WhenSelection) WhenSelection();
+    Vector<bool> before = SnapSelection();
+    selection.Zero();
+    NoteSelection(GallerySelectionChange::UNSELECT, 0, items.GetCount() - 1);
+    RefreshSelection(before); NotifySelection();
 }
 void IconGalleryCtrl::DoRemoveSelected() {
-    Vector<IconGalleryItem> keep;
-    keep.Reserve(items.GetCount());
-    for(auto& it : items) if(!it.selected) keep.Add(pick(it));
-    items = pick(keep);
+    if(IsVirtual()) return;
+    items.Remove(selection);
+    ClearComposites(); // keyed by item index
+    search.Remove(selection);
+    filtered.Remove(selection);
+    ViewRemoved(selection);
+    selection.SetCount(0);
+    selection.SetCount(items.GetCount());
+    sel_delta.Clear(); // indices shifted: report as "nothing selected"
+    NoteSelection(GallerySelectionChange::UNSELECT, 0, items.GetCount() - 1);
+    CancelThumbs(); // queued indices no longer match, loads of removed items die here
+    loading_count = 0;
+    items.ClearFlag(GalleryItemStore::QUEUED);
+    for(int i = 0; i < items.GetCount(); ++i)
+        loading_count += items.IsLoading(i);
     anchor_index = hover_index = -1;
-    Reflow(); Refresh(); if(WhenSelection) WhenSelection();
+    Reflow(); Refresh(); NotifySelection();
 }
 void IconGalleryCtrl::DoRemoveAll() {
+    CancelThumbs();
     items.Clear();
+    ClearComposites();
+    order.Clear();
+    view.Clear();
+    slot_of.Clear();
+    sort_hue.Clear();
+    status_moved.Clear();
+    view_identity = true;
+    view_dirty = false;
+    search.Clear();
+    filtered.SetCount(0);
+    selection.SetCount(0);
+    sel_delta.Clear();
+    loading_count = 0;
     anchor_index = hover_index = -1;
-    Reflow(); Refresh(); if(WhenSelection) WhenSelection();
+    Reflow(); Refresh(); NotifySelection();
 }
@@ -2,6 +2,11 @@
 #include <CtrlLib/CtrlLib.h>
 using namespace Upp;
 
+class ThumbDiskCache;
+class GalleryBits;
+class GalleryLibrary;
+class IconGalleryCtrl;
+
 // ---------- Data ----------
 enum class ThumbStatus {
     Auto,        // generated dummy (checker + tinted block)
@@ -9,20 +14,544 @@ enum class ThumbStatus {
     Missing      // warning exclamation mark
 };
 
-struct IconGalleryItem : Moveable<IconGalleryItem> {
-    String name;
+// How a non-square source is placed on its square tile
+enum class ThumbFit {
+    Fit,         // whole image, letterboxed on transparent
+    Fill,        // centered square crop
+    Stretch      // distorted to the square
+};
+
+enum class ResampleQuality {
+    Best,        // Lanczos-3
+    Fast         // box (area average)
+};
+
+// Disk-cache key part for thumbs resampled with (f, q); the defaults are 0
+inline int ThumbVariant(ThumbFit f, ResampleQuality q) { return int(f) | int(q) << 2; }
+
+// One cached zoom level of an item's thumbnail
+struct ThumbMip : Moveable<ThumbMip> {
+    int    zi    = -1;      // zoom_steps index, -1 = free slot
+    int    stamp = 0;       // paint frame of last use, oldest slot is recycled
+    Image  normal;
+    Image  gray;            // built only once the tile is actually shown desaturated
+};
+
+enum { THUMB_MIP_SLOTS = 3 }; // zoom levels kept per item
 
+// Heavy part of an item, allocated only while an image or a file is attached
+struct GalleryPayload {
     // Source image (optional): if non-empty, we scale it at current zoom
     Image  src;
+    String src_path;        // file-backed item: src is reloaded (or read from the disk cache) on demand
+    int    seen = 0;        // paint frame the tile was last in view
 
-    // Cached thumbs at current zoom
-    Image  thumb_normal;
-    Image  thumb_gray;
+    // Cached thumbs for the most recently used zoom levels
+    ThumbMip mip[THUMB_MIP_SLOTS];
+};
+
+// ---------- Virtual items ----------
+// Items served on demand: the gallery asks only for the indices near the viewport and keeps
+// no per-item state beyond the selection and filter bits. GetThumb runs on worker threads;
+// tile 0 asks for the full-size image (export), an empty result turns the tile Missing.
+class GalleryProvider {
+public:
+    virtual int         GetCount() const = 0;
+    virtual String      GetName(int i) const = 0;
+    virtual ThumbStatus GetStatus(int i) const        { return ThumbStatus::Auto; }
+    virtual Color       GetSeed(int i) const          { return Null; } // Null: tint from the name
+    virtual bool        HasThumb(int i) const         { return false; } // false: seed tile
+    virtual Image       GetThumb(int i, int tile) const { return Image(); }
 
-    Color  seed;            // deterministic tint from name
-    bool   selected     = false;
-    bool   filtered_out = false;
-    ThumbStatus status   = ThumbStatus::Auto;
+    virtual ~GalleryProvider() {}
+};
+
+Color GalleryNameColor(const String& name); // deterministic tint of a name
+
+// ---------- Item storage ----------
+// Columnar: the hot per-item state (status, flags, tint, revision) lives in small dense
+// arrays, names are packed back to back in one pool and payloads are separate blocks that
+// exist only for items with an image. Tags are kept by the search index only.
+// With a provider attached the columns are a cache instead: row r holds item vrow[r],
+// fetched on first access and dropped again by TrimVirtual once it leaves the window.
+class GalleryItemStore {
+public:
+    enum { QUEUED = 1, LOADING = 2, VTHUMB = 4 };
+
+    GalleryItemStore()                             { name_at.Add(0); }
+
+    int    Add(const String& name, Color seed);   // returns the new index
+    void   Reserve(int n);
+    void   Remove(const GalleryBits& drop);
+    void   Clear();
+    int    GetCount() const                        { return provider ? vcount : seed.GetCount(); }
+    bool   IsEmpty() const                         { return GetCount() == 0; }
+
+    String GetName(int i) const                    { return provider ? vname[Row(i)] : String(~pool + name_at[i], name_at[i + 1] - name_at[i]); }
+    int    CompareName(int a, int b) const;        // case-insensitive, without copying
+    Color  GetSeed(int i) const                    { return seed[Row(i)]; }
+    void   SetSeed(int i, Color c)                 { seed[Row(i)] = c; }
+    ThumbStatus GetStatus(int i) const             { return (ThumbStatus)status[Row(i)]; }
+    void   SetStatus(int i, ThumbStatus s)         { status[Row(i)] = (byte)s; }
+    int    GetRev(int i) const                     { return rev[Row(i)]; }
+    void   Touch(int i);                           // src/status changed
+
+    bool   IsQueued(int i) const                   { return flags[Row(i)] & QUEUED; }
+    bool   IsLoading(int i) const                  { return flags[Row(i)] & LOADING; }
+    void   SetFlag(int i, int f, bool b)           { byte& x = flags[Row(i)]; x = b ? x | f : x & ~f; }
+    void   ClearFlag(int f);                       // on every item
+
+    const GalleryPayload *GetPayload(int i) const  { return ~payload[Row(i)]; }
+    GalleryPayload       *GetPayload(int i)        { return ~payload[Row(i)]; }
+    GalleryPayload&       PayloadAdd(int i);       // existing or new
+    void   PayloadFree(int i)                      { payload[Row(i)].Clear(); }
+    bool   HasImage(int i) const;                  // src, src_path or a library record attached
+    int    GetPayloadCount() const;
+    template <class F> void ForEachPayload(F fn)  { for(One<GalleryPayload>& p : payload) if(p) fn(*p); }
+    Image  GetSource(int i) const;                 // src, else decoded from the library
+
+    // Library-backed items: the column exists only once a library is attached
+    void   SetLibrary(const GalleryLibrary *l);
+    const GalleryLibrary *GetLibrary() const       { return library; }
+    int    GetLibRecord(int i) const               { return lib.GetCount() ? lib[i] : -1; }
+    void   SetLibRecord(int i, int rec)            { if(lib.GetCount()) lib[i] = rec; }
+
+    // Virtual mode: the provider is not owned; SetProvider(nullptr) goes back to stored items
+    void   SetProvider(const GalleryProvider *p);
+    const GalleryProvider *GetProvider() const     { return provider; }
+    void   Invalidate(int i);                      // forget the cached row of item i
+    void   TrimVirtual(int first, int last, int max_rows); // keep rows of items first..last
+    int    GetCachedCount() const                  { return vrow.GetCount(); }
+    bool   IsCached(int i) const                   { return !provider || vrow.Find(i) >= 0; } // access won't fetch
+
+    size_t GetMemory() const;                      // bytes held for items, pixel data excluded
+
+private:
+    String              pool;     // all names, back to back
+    Vector<int>         name_at;  // name i is pool[name_at[i], name_at[i + 1])
+    Vector<Color>       seed;     // deterministic tint from name
+    Vector<byte>        status;   // ThumbStatus
+    Vector<byte>        flags;    // QUEUED: a background job is pending, LOADING: LoadThumbAsync in progress
+    Vector<int>         rev;      // bumped whenever src/status change; stale results are dropped
+    Vector<One<GalleryPayload>> payload;
+    Vector<int>         lib;      // library record or -1; empty while no library is attached
+    const GalleryLibrary *library = nullptr;
+    const GalleryProvider *provider = nullptr;
+    int                 vcount  = 0;
+    int                 vserial = 0;  // virtual revisions are unique, so a re-fetched row never matches a stale job
+    Index<int>          vrow;     // virtual mode: item held by each row
+    Vector<String>      vname;
+
+    int    Row(int i) const                        { int r; return !provider ? i : (r = vrow.Find(i)) >= 0 ? r : Fetch(i); }
+    int    Fetch(int i) const;
+    void   DropRow(int r);
+};
+
+// Lightweight read-only handle to one item, valid until items are added or removed
+class IconGalleryItem {
+public:
+    IconGalleryItem(const GalleryItemStore& s, int i) : store(&s), index(i) {}
+
+    int         GetIndex() const       { return index; }
+    String      GetName() const        { return store->GetName(index); }
+    Color       GetSeed() const        { return store->GetSeed(index); }
+    ThumbStatus GetStatus() const      { return store->GetStatus(index); }
+    bool        IsLoading() const      { return store->IsLoading(index); }
+    Image       GetSource() const      { return store->GetSource(index); }
+    String      GetSourcePath() const  { auto p = store->GetPayload(index); return p ? p->src_path : String(); }
+    Image       GetLoadedSource() const { auto p = store->GetPayload(index); return p ? p->src : Image(); } // never decodes
+    const GalleryLibrary *GetLibrary() const { return store->GetLibrary(); }
+    int         GetLibRecord() const   { return store->GetLibRecord(index); }
+
+private:
+    const GalleryItemStore *store;
+    int                     index;
+};
+
+// ---------- Word-packed bit set ----------
+inline int GalleryCtz64(uint64 x)
+{
+#ifdef COMPILER_MSC
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctzll(x);
+#endif
+}
+
+// One bit per item with a maintained population count: counting is O(1), range edits and
+// invert run a word (64 items) at a time, enumeration costs O(words + set bits).
+class GalleryBits : Moveable<GalleryBits> {
+public:
+    GalleryBits() {}
+    GalleryBits(const GalleryBits& b, int) : w(b.w, 0), count(b.count), ones(b.ones) {} // clone()
+
+    void  SetCount(int n);                 // new bits start cleared
+    int   GetCount() const                 { return count; }
+    int   GetSetCount() const              { return ones; }
+    bool  operator[](int i) const          { return (w[i >> 6] >> (i & 63)) & 1; }
+
+    void  Set(int i, bool b = true);
+    void  SetRange(int a, int b, bool v);  // [a, b)
+    void  Invert();
+    void  Zero();
+    void  Remove(const GalleryBits& drop);
+
+    int   FindNext(int i) const;           // first set bit >= i, -1 if none
+
+    template <class F>
+    void  ForEach(F fn) const {
+        for(int i = 0; i < w.GetCount(); ++i)
+            for(uint64 m = w[i]; m; m &= m - 1)
+                fn((i << 6) + GalleryCtz64(m));
+    }
+
+private:
+    Vector<uint64> w;
+    int            count = 0;
+    int            ones  = 0;
+
+    void  TrimTail();
+    void  Recount();
+};
+
+// One entry of a selection delta; runs of equal ops are coalesced
+struct GallerySelectionChange : Moveable<GallerySelectionChange> {
+    enum { SELECT, UNSELECT, TOGGLE };
+    int op;
+    int first, last; // inclusive item range
+};
+
+// ---------- Name / tag search ----------
+// Trigram postings over the lower-cased "name tags" text, item indices kept sorted and
+// maintained as items are added, edited and removed. A query intersects the postings of
+// its trigrams (rarest first) and verifies the survivors; a query that extends the
+// previous one only re-checks the previous matches.
+class GalleryFilterIndex {
+public:
+    void   Add(const String& name, const String& tags);  // becomes item GetCount() - 1
+    void   Set(int i, const String& name, const String& tags);
+    void   Remove(const GalleryBits& drop);
+    void   Clear();
+    int    GetCount() const                  { return hay.GetCount(); }
+    String GetTags(int i) const              { return tag[i]; }
+
+    const Vector<int>& Query(const String& q);          // sorted matching items
+    bool   Matches(int i, const String& q) const;
+
+private:
+    Vector<String>                hay;       // lower-cased searchable text per item
+    Vector<String>                tag;       // tags as given, for saving
+    VectorMap<dword, Vector<int>> postings;  // trigram -> sorted items
+    String                        query;     // last query (lower-cased) ...
+    Vector<int>                   result;    // ... and its matches
+    bool                          result_valid = false;
+
+    static void Trigrams(const String& s, Vector<dword>& out);
+    void   Link(int i);
+    void   Unlink(int i);
+};
+
+// ---------- Composited tiles ----------
+enum {
+    TILE_SELECTED      = 1, // selection border
+    TILE_HOVER         = 2, // hover tint (unselected tiles only)
+    TILE_GRAY          = 4, // desaturated thumb, disabled caption
+    TILE_FILTER_BORDER = 8, // paper stroke of unfiltered tiles
+    TILE_VARIANTS      = 16
+};
+
+// Fully rendered tiles (panel, thumb, caption, borders) of one item at one zoom level
+struct GalleryTileComposite {
+    int    rev   = -1;             // item revision the images were built for
+    int    stamp = 0;              // paint frame of last use
+    String caption;                // name fitted to the tile width, measured once
+    Image  variant[TILE_VARIANTS]; // built on first use
+};
+
+// ---------- Background thumbnail jobs ----------
+struct ThumbJob : Moveable<ThumbJob> {
+    int         index = -1;   // item index
+    int         slot  = -1;   // display slot at queue time, checked against the prefetch window
+    int         epoch = 0;    // gallery epoch (zoom / removal); stale jobs are skipped
+    int         rev   = 0;    // item thumb_rev at queue time
+    int         zi    = 0;    // zoom level being rendered
+    int         tile  = 0;
+    bool        need_normal = false;
+    bool        need_gray   = false;
+    bool        io          = false; // needs file I/O + decode, limited to max_io workers
+    bool        timed       = false; // instrumentation on: fill the ThumbResult timings
+    Image       src;          // original, or the nearest larger cached level
+    String      path;         // used when src is empty: disk cache first, then decode
+    ThumbDiskCache *disk = nullptr;
+    const GalleryLibrary *lib = nullptr; // library item (rec >= 0): stored thumb, else stored source
+    int         rec = -1;
+    const GalleryProvider *provider = nullptr; // virtual item: GetThumb(index, tile)
+    ThumbFit    fit = ThumbFit::Fit;
+    ResampleQuality quality = ResampleQuality::Best;
+};
+
+struct ThumbResult : Moveable<ThumbResult> {
+    int   index = -1;
+    int   epoch = 0;
+    int   rev   = 0;
+    int   zi    = 0;
+    bool  done  = false;      // false: job was cancelled before it ran
+    bool  failed = false;     // file-backed source could not be loaded
+    Image normal;
+    Image gray;
+    int   decode_us = 0;      // timings, only when the job was timed
+    int   scale_us  = 0;
+    int   gray_us   = 0;
+};
+
+// ---------- Instrumentation ----------
+// One painted frame; worker figures cover the results applied since the previous frame
+struct GalleryStats {
+    int    frame           = 0;
+    int64  paint_us        = 0; // whole Paint
+    int64  tiles_us        = 0; // tile loop ...
+    int64  compose_us      = 0; // ... of which building composited tiles (thumb, caption text, borders)
+    int64  queue_us        = 0; // neighbour scan + QueueThumbs
+    int64  layout_us       = 0; // Reflow since the previous frame
+    int    tiles           = 0; // tiles drawn
+    int    composite_hits  = 0;
+    int    composite_misses = 0;
+    int    thumb_hits      = 0; // visible image tiles with a ready thumb
+    int    thumb_misses    = 0; // ... and without one
+    int    thumbs_done     = 0;
+    int    thumbs_failed   = 0;
+    int64  decode_us       = 0; // worker time: pack read or file decode ...
+    int64  scale_us        = 0; // ... rescale ...
+    int64  gray_us         = 0; // ... desaturation
+    int    queue_depth     = 0; // jobs waiting
+    int    workers         = 0; // drain tasks running ...
+    int    io              = 0; // ... of which inside file I/O
+    int    pending_loads   = 0;
+    int64  composite_bytes = 0;
+    int64  atlas_bytes     = 0;
+    int64  disk_bytes      = 0; // thumbnail pack, when attached
+    int64  thumb_bytes     = 0; // cached levels + reloadable sources, as of the last budget check
+    int    evicted         = 0; // levels and sources dropped by the budget so far
+};
+
+// ---------- Pixel kernels ----------
+// Luma desaturation of premultiplied RGBA, SSE2/AVX2 when the build allows it.
+// amount: 0 = unchanged, 256 = fully gray; in-between blends color towards gray.
+void  DesaturateRGBA(RGBA *t, const RGBA *s, int count, int amount = 256);
+Image DesaturateImage(const Image& m, int amount = 256);
+
+// Separable resampling of premultiplied RGBA with precomputed integer weight tables and SSE2
+// inner loops. Sources at least twice (Fast) or four times (Best) the target are first
+// halved with 2x2 averages, so big art costs little more than its decode.
+Image ResampleImage(const Image& m, Size sz, ResampleQuality q = ResampleQuality::Best);
+Image ResampleThumb(const Image& m, int tile, ThumbFit fit = ThumbFit::Fit,
+                    ResampleQuality q = ResampleQuality::Best);
+
+// ---------- Shared tile atlas ----------
+// Status glyphs, Auto dummies and checkerboards are identical for every item with the same
+// (status, tile size, gray, seed), so they are rendered once and shared. Thread-safe;
+// returned references stay valid for the lifetime of the process.
+class GalleryTileAtlas {
+public:
+    static const Image& Checker(int tile);
+    static const Image& Get(ThumbStatus s, int tile, bool gray, Color seed = Null);
+    static Image        Build(ThumbStatus s, int tile, bool gray, Color seed = Null); // uncached
+    static Color        GrayOf(Color c);
+    static int          GetCount();
+    static int64        GetBytes();
+};
+
+// ---------- Batch PNG export ----------
+struct GalleryExportItem : Moveable<GalleryExportItem> {
+    String      name;
+    Image       src;              // shared with the gallery, not a copy
+    String      src_path;         // decoded by the worker when src is empty
+    Color       seed;
+    ThumbStatus status = ThumbStatus::Auto;
+    const GalleryProvider *provider = nullptr; // virtual item: fetched by the worker
+    int         index = -1;
+    const GalleryLibrary  *lib = nullptr;      // library item: decoded by the worker; the library
+    int         rec = -1;                      // must stay open and unsaved until the export ends
+
+    bool HasImage() const         { return !src.IsEmpty() || !IsNull(src_path) || lib || provider; } // else a generated tile
+};
+
+// Renders each item at each size and writes <dir>/<size>/<name>.png from a pool of threads.
+// A worker holds one decoded source and one scaled bitmap at a time, so memory is bounded
+// by the thread count however many icons are exported.
+class GalleryExporter {
+public:
+    Event<int, int> WhenProgress;   // files written, total; GUI thread, about 10 Hz
+    Event<>         WhenDone;       // finished or cancelled
+
+    static Vector<GalleryExportItem> Snapshot(const IconGalleryCtrl& g, const Vector<int>& items);
+    static Image    Decode(const GalleryExportItem& it); // src, else the file, the library or the provider
+    static Image    Render(const GalleryExportItem& it, const Image& decoded, int px);
+    static String   FileTitle(const String& name);
+
+    bool  Start(Vector<GalleryExportItem>&& items, const Vector<int>& sizes, const String& dir, int threads = 0);
+    void  Cancel()                  { cancel = true; }
+    void  Wait();                   // joins the workers (also fine without an event loop)
+    bool  IsRunning() const         { return running; }
+    int   GetDone() const           { return done; }
+    int   GetFailed() const         { return failed; }
+    int   GetTotal() const          { return items.GetCount() * sizes.GetCount(); }
+
+    ~GalleryExporter()              { Cancel(); Wait(); }
+
+private:
+    Vector<GalleryExportItem> items;
+    Vector<String>    files;        // unique file title per item
+    Vector<int>       sizes;
+    String            dir;
+    Array<Thread>     threads;
+    std::atomic<int>  next { 0 }, done { 0 }, failed { 0 }, live { 0 };
+    std::atomic<bool> cancel { false };
+    bool              running = false;
+    TimeCallback      poll;
+
+    void  Worker();
+    void  Poll();
+};
+
+// ---------- Sprite-sheet export ----------
+// Shelf packing: tallest first, left to right, a new shelf when the row is full. The sheet is
+// about square. Returns its size; out[i] is where rects[i] went, with pad pixels around it.
+Size GalleryShelfPack(const Vector<Size>& rects, Vector<Rect>& out, int pad = 1);
+
+struct GalleryAtlasEntry : Moveable<GalleryAtlasEntry> {
+    String name;
+    Rect   rect;
+};
+
+// name -> rect of one sheet, stored as <title>_<px>.json and as <title>_<px>.igat:
+//   "IGAT" | int32 version | int32 px | int32 cx | int32 cy | int32 count
+//   records: int32 x | int32 y | int32 cx | int32 cy | int32 name_len | name
+struct GalleryAtlasIndex {
+    int                       px = 0;
+    Size                      size = Size(0, 0);
+    String                    image;        // sheet file name, relative to the index
+    Vector<GalleryAtlasEntry> entry;        // in export order
+
+    String ToJson() const;
+    bool   LoadJson(const String& s);
+    String ToBinary() const;
+    bool   LoadBinary(const String& s);
+};
+
+// One sheet per size in dir. Every source is decoded once and drawn into all sheets, then the
+// sheets are encoded and written in parallel. Returns false if a file could not be written.
+bool GalleryExportAtlas(const Vector<GalleryExportItem>& items, const Vector<int>& sizes,
+                        const String& dir, const String& title = "atlas");
+
+// ---------- Persistent thumbnail cache ----------
+// Pre-scaled thumbnails keyed by source path + size + mtime + tile size + variant (the fit
+// and quality they were resampled with, see ThumbVariant), stored in an
+// append-only pack that is memory-mapped on open, so a warm start copies thumbs straight
+// from disk without decoding the sources. New thumbs are buffered and appended by Flush(),
+// run by Put once FLUSH_BYTES are pending and on Close; the pack is compacted when it would
+// exceed the byte limit. Thread-safe.
+class ThumbDiskCache {
+public:
+    bool   Open(const String& path, int64 max_bytes = 256 << 20);
+    void   Close();
+    bool   IsOpen() const            { return !IsNull(path); }
+
+    Image  Get(const String& file, int tile, int variant = 0);
+    void   Put(const String& file, int tile, const Image& thumb, int variant = 0);
+    void   Flush();
+    void   Compact();
+
+    void   SetMaxBytes(int64 n)      { max_bytes = n; }
+    int64  GetBytes() const;
+    int    GetCount() const;
+    int    GetHits() const           { return hits; }
+    int    GetMisses() const         { return misses; }
+
+    static String FileKey(const String& file, int tile, int variant = 0); // Null when the file is gone
+
+    ~ThumbDiskCache();
+
+private:
+    enum { FLUSH_BYTES = 8 << 20 }; // pending thumbs are also held by the gallery: keep it small
+
+    struct Entry : Moveable<Entry> { int64 offset; Size size; };
+
+    mutable Mutex            lock;
+    String                   path;
+    int64                    max_bytes = 256 << 20;
+    FileMapping              map;
+    VectorMap<String, Entry> index;  // key -> pixels inside map
+    Vector<bool>             used;   // index entries hit this session (kept first on compaction)
+    VectorMap<String, Image> fresh;  // produced this session, not yet on disk
+    int64                    fresh_bytes = 0;
+    std::atomic<int>         hits { 0 }, misses { 0 };
+
+    bool   MapIndex();
+    void   Flush0();
+    void   Compact0();
+};
+
+// Moves tmp over path. On failure path is left as it was, never removed first.
+bool GalleryReplaceFile(const String& tmp, const String& path);
+
+// ---------- Library file ----------
+// One row of a library save. A row that is unchanged since the library was opened passes its
+// record in from: its blobs stay where they are on disk and only the table row is rewritten.
+struct GalleryLibraryRow : Moveable<GalleryLibraryRow> {
+    String        name;
+    String        tags;
+    Color         seed;
+    ThumbStatus   status = ThumbStatus::Auto;
+    int           from = -1;       // record of the open library to reuse, or -1
+    String        src;             // new rows: encoded source (PNG or the original file bytes)
+    Vector<Image> thumbs;          // new rows: pre-scaled square thumbnails
+};
+
+// A persisted gallery, memory-mapped on open. The metadata columns are read straight from the
+// mapping and the blobs (sources, thumbnails) are only touched when an item is shown. Save()
+// appends new blobs and a new table, then repoints the header, so the file is never rewritten
+// except by Compact(). Open/Save/Compact/Close belong to one thread; the getters are thread-safe.
+class GalleryLibrary {
+public:
+    bool   Open(const String& path);     // a missing file opens as an empty library
+    void   Close();
+    bool   IsOpen() const               { return !IsNull(path); }
+    String GetPath() const              { return path; }
+
+    int         GetCount() const        { return count; }
+    String      GetName(int i) const;
+    Color       GetSeed(int i) const;
+    ThumbStatus GetStatus(int i) const;
+    String      GetTags(int i) const;
+    bool        HasImage(int i) const;  // a source or thumbnails are stored
+    Image       GetSource(int i) const; // decodes the stored source
+    Image       GetThumb(int i, int tile) const; // exact size, else scaled from the nearest stored one
+
+    bool   Save(const Vector<GalleryLibraryRow>& rows); // rows replace all records
+    bool   Compact();                   // drops the blobs and tables no record refers to
+    int64  GetBytes() const;
+    int64  GetLiveBytes() const;        // what Compact would keep
+
+    ~GalleryLibrary()                   { Close(); }
+
+private:
+    struct Thumb : Moveable<Thumb> { int tile; int64 offset; };
+
+    mutable Mutex lock;
+    String        path;
+    FileMapping   map;
+    int           count = 0;
+    int64         name_at = 0, names = 0, seeds = 0, status = 0, tags_at = 0, tags = 0;
+    int64         src_off = 0, src_len = 0, thumb_at = 0, thumbs = 0; // column offsets in map
+
+    bool   IsRecord(int i) const        { return i >= 0 && i < count; }
+    bool   MapTable();
+    void   GetThumbs(int i, Vector<Thumb>& out) const;
+    String Slice(int64 at_col, int64 pool, int i) const;
+    bool   Write(const String& file, const Vector<GalleryLibraryRow>& rows, bool append);
 };
 
 // ---------- Control ----------
@@ -30,32 +559,138 @@ class IconGalleryCtrl : public Ctrl {
 public:
     Event<const IconGalleryItem&> WhenActivate;
     Event<>                       WhenSelection;
+    Event<const Vector<GallerySelectionChange>&> WhenSelectionDelta; // fired right before WhenSelection
     Event<int>                    WhenZoom;
+    Event<const GalleryStats&>    WhenStats; // after every painted frame, while instrumented
 
     IconGalleryCtrl();
+    ~IconGalleryCtrl();
 
     // Items
     int   Add(const String& name, const Image& opt_img = Image(), Color tint = Null);
     void  AddDummy(const String& name);
 
+    // Batched insertion: Reflow/Refresh run once, at the outermost EndUpdate
+    void  BeginUpdate()                   { update_depth++; }
+    void  EndUpdate();
+    int   AddRange(const Vector<String>& names, const Vector<Image>& imgs = Vector<Image>());
+    void  Reserve(int n)                  { if(!IsVirtual()) items.Reserve(n); }
+    int   GetCount() const                { return items.GetCount(); }
+    IconGalleryItem GetItem(int i) const  { return IconGalleryItem(items, i); }
+
     // Attach / clear real image
     bool  SetThumbFromFile(int index, const String& filepath);
     void  SetThumbImage(int index, const Image& img);
     void  ClearThumbImage(int index);
 
+    // Asynchronous loading: the tile shows a Placeholder at once and a bounded worker pool
+    // decodes the file, viewport first, then the neighbouring pages. Loads are cancelled
+    // with their items; a failure turns the tile Missing like SetThumbFromFile does.
+    void  LoadThumbAsync(int index, const String& filepath);
+    void  SetLoadThreads(int n)        { max_io = max(1, n); }
+    int   GetPendingLoads() const      { return loading_count; }
+    bool  IsThumbWorkPending() const;  // jobs queued, running or waiting for the GUI
+
+    // Optional persistent cache for SetThumbFromFile (not owned, must outlive the control)
+    void  SetDiskCache(ThumbDiskCache *cache) { disk_cache = cache; }
+
+    // Memory budget for cached thumbnail levels and the sources of file-backed items (0 = none).
+    // Past it the least recently visible are dropped, never tiles in view, and rebuilt when
+    // scrolled back in; file-backed sources are re-read from the file or the disk cache.
+    // In-memory sources set with SetThumbImage are the only copy and are never dropped.
+    void  SetThumbBudget(int64 bytes)     { thumb_budget = bytes; TrimThumbs(); }
+    void  SetEvictSources(bool b)         { evict_src = b; }
+    int64 GetThumbBudget() const          { return thumb_budget; }
+    int64 GetThumbBytes();                // measured now: levels + file-backed sources
+    int   GetEvictedThumbs() const        { return evicted_thumbs; }  // levels (normal + gray)
+    int   GetEvictedSources() const       { return evicted_src; }
+
+    // Resampling of image sources onto tiles; changing either rebuilds every cached level
+    void  SetThumbFit(ThumbFit f);
+    void  SetThumbQuality(ResampleQuality q);
+    ThumbFit        GetThumbFit() const     { return thumb_fit; }
+    ResampleQuality GetThumbQuality() const { return thumb_quality; }
+
+    // Library: OpenLibrary replaces the items with the library records, copying only names,
+    // tints, status and tags; thumbnails come out of the mapping as their tiles are shown.
+    // The library is not owned and must stay open while the control uses it. SaveLibrary
+    // stores every item, with thumbnails at the given tile sizes (default: the current one),
+    // and only writes what is new since the library was opened or last saved.
+    void  OpenLibrary(const GalleryLibrary& lib);
+    bool  SaveLibrary(GalleryLibrary& lib, const Vector<int>& tiles = Vector<int>());
+
+    // Virtual mode: items come from the provider (not owned) on demand and only the rows near
+    // the viewport are cached, so memory does not grow with the count beyond the selection and
+    // filter bits. Layout, scrolling, hit-testing, selection and thumbnails work as usual;
+    // adding, removing, sorting, text filtering, hiding and per-item images/status are the
+    // provider's business and ignored here. Tell the control when the provider changes.
+    void  SetProvider(GalleryProvider *p);     // nullptr: back to an empty, stored gallery
+    bool  IsVirtual() const                    { return items.GetProvider() != nullptr; }
+    void  ProviderChanged();                   // count or many items changed
+    void  ProviderItemChanged(int index);      // name, status, seed or thumb of one item
+    int   GetCachedItemCount() const           { return items.GetCachedCount(); }
+    const GalleryProvider *GetProvider() const { return items.GetProvider(); }
+
     // Status
     void  SetThumbStatus(int index, ThumbStatus s);
 
     // Selection
-    Vector<int> GetSelection() const;
+    Vector<int> GetSelection() const;                 // O(selected)
+    int         GetSelectionCount() const             { return selection.GetSetCount(); }
+    int         GetFirstSelected() const              { return selection.FindNext(0); }
+    bool        IsSelected(int i) const               { return selection[i]; }
+    void        Select(int i, bool b = true);
+    void        SelectAll()                           { DoSelectAll(); }
+    void        InvertSelection()                     { DoInvertSelection(); }
+    void        ClearSelection()                      { DoClearSelection(); }
+    void        RemoveSelected()                      { DoRemoveSelected(); }
+    void        RemoveAll()                           { DoRemoveAll(); }
+
+    // Hit-testing (view coordinates, O(1) grid math)
+    int         GetIndexAt(Point p) const;            // item under p or -1
+    Vector<int> GetItemsInRect(const Rect& r) const;  // items whose tile intersects r
 
     // Filtering
     void  SetFiltered(int index, bool filtered_out);
-    void  ClearFilterFlags();
+    void  ClearFilterFlags();                      // also drops the filter text
+    bool  IsFiltered(int index) const             { return filtered[index]; }
+    int   GetFilteredCount() const                { return filtered.GetSetCount(); }
+
+    // Built-in search: items whose name or tags do not contain the text are filtered out
+    void   SetFilterText(const String& text);
+    String GetFilterText() const                  { return filter_text; }
+    void   SetTags(int index, const String& tags);
+
+    // View order: display slots map to item indices, items themselves never move.
+    // Sorting is stable on ties (item index) and kept up to date as items are added or removed.
+    enum { SORT_NONE, SORT_NAME, SORT_COLOR, SORT_STATUS };
+    void  SetSort(int by, bool descending = false);
+    int   GetSort() const                         { return sort_by; }
+    bool  IsSortDescending() const                { return sort_desc; }
+    void  SetHideFiltered(bool b);                 // filtered items leave the layout
+    bool  GetHideFiltered() const                 { return hide_filtered; }
+    int   GetViewCount() const                    { return ViewCount(); }
+    int   GetViewItem(int slot) const             { return ViewAt(slot); }
+    int   GetItemSlot(int i) const                { return SlotOf(i); } // -1 when hidden
+
+    // Instrumentation: off by default, costs a flag test per frame while off
+    void  SetInstrumentation(bool b);
+    bool  IsInstrumented() const                  { return instrument; }
+    const GalleryStats& GetStats() const          { return stats; }   // last frame
+    void  ShowHud(bool b);                        // instruments while shown, unless already on
+    bool  IsHudShown() const                      { return show_hud; }
+    void  SetHudFrames(int n)                     { hud_frames = max(2, n); }
+
+    // Scrolling (content coordinates)
+    void  SetScrollY(int y)                       { sb.SetY(y); SyncScroll(); }
+    int   GetScrollY() const                      { return scroll_y; }
+    int   GetContentHeight() const                { return content_h; }
 
     // Zoom
     void  SetZoomIndex(int zi);
     int   GetZoomIndex() const { return zoom_i; }
+    int   GetZoomCount() const { return zoom_steps.GetCount(); }
+    int   GetTileSize(int zi) const { return zoom_steps[zi]; }
 
     // Visual toggles
     void  SetShowSelectionBorders(bool b) { show_selection_border = b; Refresh(); }
@@ -70,7 +705,7 @@ public:
     static const Image& MissingGlyph(int tile = 32);
 
 private:
-    Vector<IconGalleryItem> items;
+    GalleryItemStore items;
 
     // Layout / zoom
     Vector<int> zoom_steps {32, 48, 64, 80, 96, 112, 128};
@@ -79,6 +714,23 @@ private:
     int         pad    = 10;
     int         labelH = 16;
 
+    ThumbDiskCache *disk_cache = nullptr;
+    ThumbFit        thumb_fit     = ThumbFit::Fit;
+    ResampleQuality thumb_quality = ResampleQuality::Best;
+
+    // Thumbnail memory budget (GalleryMemory.cpp). Growth is counted as thumbs arrive;
+    // removals are not, so the usage is re-measured only once the estimate passes the budget.
+    int64           thumb_budget   = 256 << 20;
+    bool            evict_src      = true;
+    int64           thumb_bytes    = 0;   // measured at the last check
+    int64           thumb_grown    = 0;   // added since
+    int             evicted_thumbs = 0;
+    int             evicted_src    = 0;
+
+    // Batched updates
+    int         update_depth = 0;
+    bool        update_dirty = false;
+
     // Manual scrolling state (vertical)
     int         scroll_y  = 0;
     int         content_h = 0;
@@ -88,28 +740,131 @@ private:
     int         anchor_index = -1; // last “caret” for shift-range
     int         hover_index  = -1; // current hover tile or -1
 
+    // Rubber-band selection (content coordinates)
+    bool        banding       = false;
+    bool        band_additive = false;
+    Point       band_origin, band_cur;
+    Rect        band_cells = Rect(0, 0, 0, 0); // half-open col/row range covered by the band
+    GalleryBits band_base;         // selection before the drag, for Ctrl+drag restores
+
+    // Selection / filter state, indexed like items
+    GalleryBits selection;
+    GalleryBits filtered;
+    GalleryFilterIndex search;
+    String      filter_text;
+    Vector<GallerySelectionChange> sel_delta; // pending changes for WhenSelectionDelta
+
+    // View order (GUI thread only)
+    Vector<int> order;             // all items, sorted
+    Vector<int> view;              // display slot -> item: order without hidden items
+    Vector<int> slot_of;           // item -> display slot or -1
+    Vector<int> sort_hue;          // SORT_COLOR keys, indexed like items
+    Vector<int> status_moved;      // SORT_STATUS: items out of place in order until FlushStatusMoves
+    int         sort_by       = SORT_NONE;
+    bool        sort_desc     = false;
+    bool        hide_filtered = false;
+    bool        view_identity = true;  // view[i] == i, so slot ranges are item ranges
+    bool        view_dirty    = false; // view/slot_of lag behind order, rebuilt by Reflow
+
     // Visual toggles
     bool        show_selection_border = true;
     bool        show_filter_border    = true;
     bool        saturation_on         = true;
 
+    // Background thumbnail pipeline (GUI thread owns items; workers only see ThumbJob copies)
+    enum { TIMEID_THUMBS = Ctrl::TIMEID_COUNT, TIMEID_COUNT };
+
+    mutable Mutex      thumb_lock;
+    Vector<ThumbJob>   thumb_queue;    // viewport first, then neighbours; guarded by thumb_lock
+    Vector<ThumbResult> thumb_done;    // finished jobs waiting for the GUI, guarded by thumb_lock
+    int                thumb_workers = 0; // running drain tasks, guarded by thumb_lock
+    int                thumb_io      = 0; // workers inside file I/O + decode, guarded by thumb_lock
+    int                max_io        = 4;
+    int                loading_count = 0;
+    std::atomic<int>   thumb_epoch { 0 };
+    std::atomic<int>   vis_first { 0 }, vis_last { -1 }; // prefetch window; jobs outside are dropped
+    int                paint_frame = 0; // stamps mip usage, GUI thread only
+    CoWork             thumb_work;     // declared last of the pipeline: joined before the rest dies
+
+    // Instrumentation (GUI thread)
+    bool               instrument = false;
+    bool               show_hud   = false;
+    bool               hud_instrument = false; // instrumentation is on only for the HUD
+    int                hud_frames = 120;
+    GalleryStats       stats;          // last published frame
+    GalleryStats       acc;            // frame being measured, plus results drained since the last one
+    BiVector<int>      frame_times;    // paint_us of the last hud_frames frames
+
+    // Composited tiles, keyed by zoom_i << 32 | item; cleared on removal and theme change
+    enum { CAPTION_MARGIN = 6 };
+    ArrayMap<int64, GalleryTileComposite> composites;
+    dword              composite_theme = 0;
+
     // Helpers
+    void   Changed();
+    void   ApplyFilterText();
+    bool   WantGray(int i) const { return !saturation_on || filtered[i]; }
     void   Reflow();
-    Rect   IndexRectNoScroll(int i) const;
-    Rect   IndexRect(int i) const;
-    void   EnsureThumbs(IconGalleryItem& it);
-    Color  AutoColorFromText(const String& s) const;
+    void   SyncScroll();
+    void   VisibleSlots(int& first, int& last) const;
+    Rect   IndexRectNoScroll(int slot) const;
+    Rect   IndexRect(int slot) const;
+    Rect   ItemRect(int i) const;          // empty when the item is hidden
+    int    SlotAt(Point p) const;
+    int    SlotOf(int i) const { return IsVirtual() ? (i >= 0 && i < items.GetCount() ? i : -1)
+                                                    : i >= 0 && i < slot_of.GetCount() ? slot_of[i] : -1; }
+    int    ViewCount() const   { return IsVirtual() ? items.GetCount() : view.GetCount(); }
+    int    ViewAt(int slot) const { return IsVirtual() ? slot : view[slot]; } // virtual: always identity
+    Rect   CellRange(const Rect& content) const;
+    void   UpdateBand(Point p);
+    void   RefreshBand();
+    static const ThumbMip* FindMip(const GalleryPayload& p, int zi);
+    static ThumbMip*       FindMip(GalleryPayload& p, int zi);
+    static ThumbMip&       MipSlot(GalleryPayload& p, int zi);
+    static void            ClearMips(GalleryPayload& p);
+    void   SetFileThumb(int index, const String& path, const Image& thumb);
+    void   EndLoad(int i);
+    bool   ThumbReady(int i, bool want_gray) const;
+    void   QueueThumbs(const Vector<int>& want, int first, int last);
+    void   CancelThumbs();
+    void   ResetThumbs();
+    void   ThumbsGrown(int64 bytes)     { thumb_grown += bytes; if(thumb_budget > 0 && thumb_bytes + thumb_grown > thumb_budget) TrimThumbs(); }
+    void   TrimThumbs();
+    int    ThumbVariant() const { return ::ThumbVariant(thumb_fit, thumb_quality); }
+    void   ThumbWorker();
+    void   DrainThumbs();
+    static void RenderThumbs(const ThumbJob& job, ThumbResult& r);
+
+    // View order (GalleryView.cpp)
+    bool   ViewLess(int a, int b) const;
+    int    HueKey(int i) const;
+    void   RebuildOrder();
+    void   RebuildView();
+    void   ViewChanged() { view_dirty = true; Changed(); }
+    void   ViewAdded(int first);
+    void   ViewRemoved(const GalleryBits& drop);
+    void   StatusChanged(int i);
+    void   FlushStatusMoves();
 
     // Drawing helpers
     void   StrokeRect(Draw& w, const Rect& r, int t, const Color& c) const;
-    void   DrawPlaceholderGlyph(BufferPainter& p, int tile, bool gray) const;
-    void   DrawMissingGlyph(BufferPainter& p, int tile, bool gray) const;
-
-    static Image MakePlaceholderGlyph(int tile, bool gray);
-    static Image MakeMissingGlyph(int tile, bool gray);
+    void   PaintTile(Draw& w, const Rect& box, int i, int variant, const String& caption,
+                     const ThumbMip* mip) const;
+    GalleryTileComposite& Composite(int i);
+    void   TrimComposites(int keep);
+    void   ClearComposites()            { composites.Clear(); }
+    static String FitCaption(const String& name, int cx, Font font);
+    Rect   HudRect() const;
+    void   PaintHud(Draw& w) const;
+    void   PublishStats();
 
     // Selection helpers
     void   SelectRange(int a, int b, bool additive);
+    void   SelectItem(int i, bool b);
+    Vector<bool> SnapSelection() const;
+    void   RefreshSelection(const Vector<bool>& before);
+    void   NoteSelection(int op, int first, int last);
+    void   NotifySelection();
 
     // Context menu
     void   ShowContextMenu(Point p);
@@ -123,6 +878,7 @@ private:
     void   Layout() override { Reflow(); Refresh(); }
     void   Paint(Draw& w) override;
     void   LeftDown(Point p, dword flags) override;
+    void   LeftUp(Point p, dword flags) override;
     void   LeftDouble(Point p, dword flags) override;
     void   RightDown(Point p, dword flags) override;
     void   MouseMove(Point p, dword flags) override;
@@ -0,0 +1,318 @@
+#include "IconGalleryCtrl.h"
+
+#ifdef CPU_SSE2
+#include <emmintrin.h>
+#endif
+
+// Separable two-pass resampling of premultiplied RGBA: a horizontal pass into an 8-bit
+// buffer of target width, then a vertical pass into the target. Every output pixel reads a
+// fixed window of `taps` source pixels with 14-bit integer weights built once per axis, so
+// the inner loops are multiply-adds only.
+
+enum { WEIGHT_BITS = 14, WEIGHT_ONE = 1 << WEIGHT_BITS };
+
+struct ResampleAxis {
+    int           taps = 0;
+    Buffer<int>   start;  // first source pixel of each output's window
+    Buffer<int16> weight; // taps per output, summing to WEIGHT_ONE
+};
+
+static double Lanczos3(double x)
+{
+    x = fabs(x);
+    if(x < 1e-9) return 1;
+    if(x >= 3) return 0;
+    double px = M_PI * x;
+    return 3 * sin(px) * sin(px / 3) / (px * px);
+}
+
+// Box: the output pixel's footprint averaged by area coverage. Lanczos-3: stretched by the
+// reduction factor when shrinking. Taps that fall off the source are folded onto the edge
+// pixel and the window is slid inside [0, n), so the kernels never read out of bounds.
+static void BuildAxis(ResampleAxis& a, int n, int m, bool box)
+{
+    double scale = double(n) / m;
+    double fs = max(scale, 1.0);
+    double support = box ? 0.5 * fs : 3 * fs;
+    int ideal = (int)ceil(2 * support) + 1;
+    a.taps = min(ideal, n);
+    a.start.Alloc(m);
+    a.weight.Alloc(m * a.taps);
+    Buffer<double> w(a.taps);
+    for(int x = 0; x < m; ++x) {
+        double c = (x + 0.5) * scale; // footprint center in source coordinates
+        int lo = (int)floor(c - support);
+        int s = clamp(lo, 0, n - a.taps);
+        Fill(~w, ~w + a.taps, 0.0);
+        double sum = 0;
+        for(int j = lo; j < lo + ideal; ++j) {
+            double v = box ? max(0.0, min(j + 1.0, c + support) - max((double)j, c - support))
+                           : Lanczos3((j + 0.5 - c) / fs);
+            w[clamp(j, 0, n - 1) - s] += v;
+            sum += v;
+        }
+        a.start[x] = s;
+        int16 *t = a.weight + x * a.taps;
+        int total = 0, peak = 0;
+        for(int k = 0; k < a.taps; ++k) {
+            t[k] = (int16)floor(w[k] / (sum ? sum : 1) * WEIGHT_ONE + 0.5);
+            total += t[k];
+            if(t[k] > t[peak]) peak = k;
+        }
+        t[peak] += int16(WEIGHT_ONE - total); // rounding error goes to the center tap
+    }
+}
+
+static inline byte ClampByte(int v) { return (byte)minmax(v, 0, 255); }
+
+// Negative Lanczos lobes can push a color above its alpha, which is invalid premultiplied
+static inline void ClampPremultiplied(RGBA& c)
+{
+    c.r = min(c.r, c.a);
+    c.g = min(c.g, c.a);
+    c.b = min(c.b, c.a);
+}
+
+// ---------------- Scalar kernels ----------------
+static void HorzScalar(RGBA *t, const RGBA *s, const ResampleAxis& a, int x, int m)
+{
+    for(; x < m; ++x) {
+        const RGBA *p = s + a.start[x];
+        const int16 *w = a.weight + x * a.taps;
+        int r = WEIGHT_ONE / 2, g = r, b = r, al = r;
+        for(int k = 0; k < a.taps; ++k) {
+            r  += p[k].r * w[k];
+            g  += p[k].g * w[k];
+            b  += p[k].b * w[k];
+            al += p[k].a * w[k];
+        }
+        t[x].r = ClampByte(r >> WEIGHT_BITS);
+        t[x].g = ClampByte(g >> WEIGHT_BITS);
+        t[x].b = ClampByte(b >> WEIGHT_BITS);
+        t[x].a = ClampByte(al >> WEIGHT_BITS);
+    }
+}
+
+static void VertScalar(RGBA *t, const RGBA *const *row, const int16 *w, int taps, int x, int cx)
+{
+    for(; x < cx; ++x) {
+        int r = WEIGHT_ONE / 2, g = r, b = r, al = r;
+        for(int k = 0; k < taps; ++k) {
+            const RGBA& p = row[k][x];
+            r  += p.r * w[k];
+            g  += p.g * w[k];
+            b  += p.b * w[k];
+            al += p.a * w[k];
+        }
+        RGBA& c = t[x];
+        c.r = ClampByte(r >> WEIGHT_BITS);
+        c.g = ClampByte(g >> WEIGHT_BITS);
+        c.b = ClampByte(b >> WEIGHT_BITS);
+        c.a = ClampByte(al >> WEIGHT_BITS);
+        ClampPremultiplied(c);
+    }
+}
+
+static void HalveScalar(RGBA *t, const RGBA *a, const RGBA *b, int x, int cx)
+{
+    for(; x < cx; ++x) {
+        const RGBA *p = a + 2 * x, *q = b + 2 * x;
+        t[x].r = byte((p[0].r + p[1].r + q[0].r + q[1].r + 2) >> 2);
+        t[x].g = byte((p[0].g + p[1].g + q[0].g + q[1].g + 2) >> 2);
+        t[x].b = byte((p[0].b + p[1].b + q[0].b + q[1].b + 2) >> 2);
+        t[x].a = byte((p[0].a + p[1].a + q[0].a + q[1].a + 2) >> 2);
+    }
+}
+
+// ---------------- SSE2 kernels ----------------
+#ifdef CPU_SSE2
+// Two weights for _mm_madd_epi16 over channel pairs (first, second)
+static inline __m128i WeightPair(int16 w0, int16 w1)
+{
+    return _mm_set1_epi32(int(((dword)(uint16)w1 << 16) | (uint16)w0));
+}
+
+static inline __m128i LoadPixel(const RGBA *p)
+{
+    dword d;
+    memcpy(&d, p, sizeof(d));
+    return _mm_cvtsi32_si128(int(d));
+}
+
+// One output pixel per iteration, two taps per multiply-add: channels of the tap pair are
+// interleaved so each 32-bit lane accumulates one channel.
+static int HorzSSE2(RGBA *t, const RGBA *s, const ResampleAxis& a, int m)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(WEIGHT_ONE / 2);
+    for(int x = 0; x < m; ++x) {
+        const RGBA *p = s + a.start[x];
+        const int16 *w = a.weight + x * a.taps;
+        __m128i acc = round;
+        int k = 0;
+        for(; k + 2 <= a.taps; k += 2) {
+            __m128i px = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(p + k)), zero);
+            px = _mm_unpacklo_epi16(px, _mm_srli_si128(px, 8));
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(px, WeightPair(w[k], w[k + 1])));
+        }
+        if(k < a.taps) {
+            __m128i px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(LoadPixel(p + k), zero), zero);
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(px, WeightPair(w[k], 0)));
+        }
+        acc = _mm_srai_epi32(acc, WEIGHT_BITS);
+        acc = _mm_packs_epi32(acc, acc);
+        acc = _mm_packus_epi16(acc, acc);
+        dword d = (dword)_mm_cvtsi128_si32(acc);
+        memcpy(t + x, &d, sizeof(d));
+    }
+    return m;
+}
+
+// Four output pixels per iteration: bytes of two source rows are interleaved so one
+// multiply-add applies both row weights to a whole pixel.
+static int VertSSE2(RGBA *t, const RGBA *const *row, const int16 *w, int taps, int cx)
+{
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32(WEIGHT_ONE / 2);
+    const __m128i amask = _mm_set1_epi32((int)(0xffu << (8 * offsetof(RGBA, a))));
+    int x = 0;
+    for(; x + 4 <= cx; x += 4) {
+        __m128i a0 = round, a1 = round, a2 = round, a3 = round;
+        for(int k = 0; k < taps; k += 2) {
+            __m128i r0 = _mm_loadu_si128((const __m128i *)(row[k] + x));
+            __m128i r1 = k + 1 < taps ? _mm_loadu_si128((const __m128i *)(row[k + 1] + x)) : zero;
+            __m128i wk = WeightPair(w[k], k + 1 < taps ? w[k + 1] : 0);
+            __m128i lo = _mm_unpacklo_epi8(r0, r1);
+            __m128i hi = _mm_unpackhi_epi8(r0, r1);
+            a0 = _mm_add_epi32(a0, _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), wk));
+            a1 = _mm_add_epi32(a1, _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), wk));
+            a2 = _mm_add_epi32(a2, _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), wk));
+            a3 = _mm_add_epi32(a3, _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), wk));
+        }
+        __m128i lo = _mm_packs_epi32(_mm_srai_epi32(a0, WEIGHT_BITS), _mm_srai_epi32(a1, WEIGHT_BITS));
+        __m128i hi = _mm_packs_epi32(_mm_srai_epi32(a2, WEIGHT_BITS), _mm_srai_epi32(a3, WEIGHT_BITS));
+        __m128i px = _mm_packus_epi16(lo, hi);
+        __m128i al = _mm_srli_epi32(_mm_and_si128(px, amask), 8 * offsetof(RGBA, a));
+        al = _mm_or_si128(al, _mm_slli_epi32(al, 8));
+        al = _mm_or_si128(al, _mm_slli_epi32(al, 16)); // alpha in every byte
+        _mm_storeu_si128((__m128i *)(t + x), _mm_min_epu8(px, al));
+    }
+    return x;
+}
+
+// Two output pixels per iteration from a 4 x 2 block
+static int HalveSSE2(RGBA *t, const RGBA *a, const RGBA *b, int cx)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two  = _mm_set1_epi16(2);
+    int x = 0;
+    for(; x + 2 <= cx; x += 2) {
+        __m128i ra = _mm_loadu_si128((const __m128i *)(a + 2 * x));
+        __m128i rb = _mm_loadu_si128((const __m128i *)(b + 2 * x));
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(ra, zero), _mm_unpacklo_epi8(rb, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(ra, zero), _mm_unpackhi_epi8(rb, zero));
+        __m128i s  = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+        s = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+        _mm_storel_epi64((__m128i *)(t + x), _mm_packus_epi16(s, s));
+    }
+    return x;
+}
+#endif
+
+// ---------------- Driver ----------------
+static void Halve(RGBA *t, const RGBA *s, int stride, Size tsz)
+{
+    for(int y = 0; y < tsz.cy; ++y) {
+        const RGBA *a = s + 2 * y * stride, *b = a + stride;
+        RGBA *r = t + y * tsz.cx;
+        int x = 0;
+#ifdef CPU_SSE2
+        x = HalveSSE2(r, a, b, tsz.cx);
+#endif
+        HalveScalar(r, a, b, x, tsz.cx);
+    }
+}
+
+// src / dst are row strides in pixels, so a crop of the source or a window of the target
+// can be passed without copying
+static void Resample(RGBA *t, int dst, Size tsz, const RGBA *s, int src, Size ssz, ResampleQuality q)
+{
+    bool box = q == ResampleQuality::Fast;
+    // Power-of-two pre-reduction: 2x2 averages are exact box steps and far cheaper than a
+    // wide kernel. Lanczos keeps at least 2x oversampling for its final pass.
+    int keep = box ? 1 : 2;
+    Buffer<RGBA> half[2];
+    for(int h = 0; ssz.cx / 2 >= keep * tsz.cx && ssz.cy / 2 >= keep * tsz.cy; h ^= 1) {
+        Size hsz = ssz / 2;
+        half[h].Alloc(hsz.cx * hsz.cy);
+        Halve(half[h], s, src, hsz);
+        s = half[h];
+        src = hsz.cx;
+        ssz = hsz;
+    }
+
+    ResampleAxis ax, ay;
+    BuildAxis(ax, ssz.cx, tsz.cx, box);
+    BuildAxis(ay, ssz.cy, tsz.cy, box);
+
+    // Only the source rows some output row reads go through the horizontal pass
+    int y0 = ay.start[0], y1 = ay.start[tsz.cy - 1] + ay.taps;
+    Buffer<RGBA> tmp(tsz.cx * (y1 - y0));
+    for(int y = y0; y < y1; ++y) {
+        RGBA *r = tmp + (y - y0) * tsz.cx;
+        int x = 0;
+#ifdef CPU_SSE2
+        x = HorzSSE2(r, s + y * src, ax, tsz.cx);
+#endif
+        HorzScalar(r, s + y * src, ax, x, tsz.cx);
+    }
+
+    Buffer<const RGBA *> row(ay.taps);
+    for(int y = 0; y < tsz.cy; ++y) {
+        for(int k = 0; k < ay.taps; ++k)
+            row[k] = tmp + (ay.start[y] + k - y0) * tsz.cx;
+        const int16 *w = ay.weight + y * ay.taps;
+        RGBA *r = t + y * dst;
+        int x = 0;
+#ifdef CPU_SSE2
+        x = VertSSE2(r, row, w, ay.taps, tsz.cx);
+#endif
+        VertScalar(r, row, w, ay.taps, x, tsz.cx);
+    }
+}
+
+// ---------------- Images ----------------
+Image ResampleImage(const Image& m, Size sz, ResampleQuality q)
+{
+    if(m.IsEmpty() || sz.cx <= 0 || sz.cy <= 0)
+        return Image();
+    if(m.GetSize() == sz)
+        return m;
+    ImageBuffer ib(sz);
+    Resample(ib.Begin(), sz.cx, sz, m.Begin(), m.GetWidth(), m.GetSize(), q);
+    return ib;
+}
+
+Image ResampleThumb(const Image& m, int tile, ThumbFit fit, ResampleQuality q)
+{
+    Size ssz = m.GetSize();
+    if(m.IsEmpty() || tile <= 0)
+        return Image();
+    if(ssz == Size(tile, tile))
+        return m;
+    if(fit == ThumbFit::Stretch || ssz.cx == ssz.cy)
+        return ResampleImage(m, Size(tile, tile), q);
+    ImageBuffer ib(tile, tile);
+    if(fit == ThumbFit::Fill) { // centered square crop
+        int side = min(ssz.cx, ssz.cy);
+        const RGBA *s = m.Begin() + (ssz.cy - side) / 2 * ssz.cx + (ssz.cx - side) / 2;
+        Resample(ib.Begin(), tile, Size(tile, tile), s, ssz.cx, Size(side, side), q);
+        return ib;
+    }
+    Size dsz = ssz.cx > ssz.cy ? Size(tile, max(1, (ssz.cy * tile + ssz.cx / 2) / ssz.cx))
+                               : Size(max(1, (ssz.cx * tile + ssz.cy / 2) / ssz.cy), tile);
+    Fill(ib.Begin(), RGBAZero(), ib.GetLength()); // letterbox
+    Point o = (Size(tile, tile) - dsz) / 2;
+    Resample(ib[o.y] + o.x, tile, dsz, m.Begin(), ssz.cx, ssz, q);
+    return ib;
+}
@@ -0,0 +1,230 @@
+#include "IconGalleryCtrl.h"
+
+// Pack file layout (little endian):
+//   "IGTC" | int32 version | int32 pixel layout
+//   records: int32 key_len | key | int32 cx | int32 cy | cx*cy premultiplied RGBA
+// Records are only ever appended; a later record for the same key wins. Compact()
+// rewrites the file when it grows past the byte limit.
+
+static const char sMagic[4] = { 'I', 'G', 'T', 'C' };
+enum { PACK_VERSION = 1, PACK_HEADER = 12 };
+
+static int PixelLayout() { return (int)offsetof(RGBA, r) | (int)offsetof(RGBA, a) << 8; }
+
+ThumbDiskCache::~ThumbDiskCache()
+{
+    Close();
+}
+
+String ThumbDiskCache::FileKey(const String& file, int tile, int variant)
+{
+    FindFile ff(file);
+    if(!ff) return Null;
+    int64 mtime = Time(ff.GetLastWriteTime()) - Time(1970, 1, 1);
+    return Format("%s|%d|%d|%d|%d", file, ff.GetLength(), mtime, tile, variant);
+}
+
+bool ThumbDiskCache::Open(const String& path_, int64 max_bytes_)
+{
+    Close();
+    Mutex::Lock __(lock);
+    path = path_;
+    max_bytes = max_bytes_;
+    if(FileExists(path) && !MapIndex()) {
+        map.Close();
+        DeleteFile(path); // unreadable or foreign layout: start over
+    }
+    return true;
+}
+
+void ThumbDiskCache::Close()
+{
+    Flush();
+    Mutex::Lock __(lock);
+    map.Close();
+    index.Clear();
+    used.Clear();
+    path.Clear();
+}
+
+// Maps the pack and indexes record headers; pixels are left on disk until requested
+bool ThumbDiskCache::MapIndex()
+{
+    index.Clear();
+    used.Clear();
+    if(!map.Open(path) || !map.Map(0, (size_t)map.GetFileSize()))
+        return false;
+    const byte *p   = map.Begin();
+    const byte *end = map.End();
+    if(end - p < PACK_HEADER || memcmp(p, sMagic, 4) || Peek32le(p + 4) != PACK_VERSION
+       || Peek32le(p + 8) != PixelLayout())
+        return false;
+    p += PACK_HEADER;
+    while(end - p >= 4) {
+        int klen = Peek32le(p);
+        if(klen < 0 || end - p < 12 + klen) break;
+        String key((const char *)p + 4, klen);
+        int cx = Peek32le(p + 4 + klen);
+        int cy = Peek32le(p + 8 + klen);
+        const byte *pixels = p + 12 + klen;
+        int64 len = (int64)cx * cy * sizeof(RGBA);
+        if(cx <= 0 || cy <= 0 || end - pixels < len) break; // torn tail from a crash
+        Entry& e = index.GetAdd(key);
+        e.offset = pixels - map.Begin();
+        e.size   = Size(cx, cy);
+        p = pixels + len;
+    }
+    used.SetCount(index.GetCount(), false);
+    return true;
+}
+
+Image ThumbDiskCache::Get(const String& file, int tile, int variant)
+{
+    String key = FileKey(file, tile, variant);
+    if(IsNull(key)) return Image();
+    Mutex::Lock __(lock);
+    int q = fresh.Find(key);
+    if(q >= 0) { hits++; return fresh[q]; }
+    q = index.Find(key);
+    if(q < 0 || !map.IsOpen()) { misses++; return Image(); }
+    const Entry& e = index[q];
+    ImageBuffer ib(e.size);
+    memcpy(ib.Begin(), map.Begin() + e.offset, e.size.cx * e.size.cy * sizeof(RGBA));
+    used[q] = true;
+    hits++;
+    return ib;
+}
+
+void ThumbDiskCache::Put(const String& file, int tile, const Image& thumb, int variant)
+{
+    String key = FileKey(file, tile, variant);
+    if(IsNull(key) || thumb.IsEmpty()) return;
+    Mutex::Lock __(lock);
+    if(IsNull(path)) return;
+    fresh.GetAdd(key) = thumb;
+    fresh_bytes += thumb.GetLength() * sizeof(RGBA);
+    if(fresh_bytes >= FLUSH_BYTES)
+        Flush0();
+}
+
+int64 ThumbDiskCache::GetBytes() const
+{
+    Mutex::Lock __(lock);
+    return map.IsOpen() ? map.GetFileSize() : 0;
+}
+
+int ThumbDiskCache::GetCount() const
+{
+    Mutex::Lock __(lock);
+    return index.GetCount() + fresh.GetCount();
+}
+
+static void PutRecord(Stream& out, const String& key, Size sz, const RGBA *pixels)
+{
+    out.Put32le(key.GetCount());
+    out.Put(key);
+    out.Put32le(sz.cx);
+    out.Put32le(sz.cy);
+    out.Put(pixels, sz.cx * sz.cy * (int)sizeof(RGBA));
+}
+
+static void PutHeader(Stream& out)
+{
+    out.Put(sMagic, 4);
+    out.Put32le(PACK_VERSION);
+    out.Put32le(PixelLayout());
+}
+
+// Appends the thumbnails produced this session. The mapping is dropped while writing
+// (a mapped file cannot grow on every platform) and re-established afterwards.
+void ThumbDiskCache::Flush()
+{
+    Mutex::Lock __(lock);
+    Flush0();
+}
+
+void ThumbDiskCache::Flush0()
+{
+    if(fresh.IsEmpty() || IsNull(path)) return;
+
+    int64 grow = 0;
+    for(int i = 0; i < fresh.GetCount(); ++i)
+        grow += 12 + fresh.GetKey(i).GetCount() + fresh[i].GetLength() * sizeof(RGBA);
+    int64 size = map.IsOpen() ? map.GetFileSize() : 0;
+    if(size + grow > max_bytes) {
+        Compact0();
+        return;
+    }
+
+    map.Close();
+    {
+        FileAppend out(path);
+        if(out.GetSize() == 0) PutHeader(out);
+        for(int i = 0; i < fresh.GetCount(); ++i)
+            PutRecord(out, fresh.GetKey(i), fresh[i].GetSize(), fresh[i].Begin());
+    }
+    fresh.Clear();
+    fresh_bytes = 0;
+    MapIndex();
+}
+
+void ThumbDiskCache::Compact()
+{
+    Mutex::Lock __(lock);
+    Compact0();
+}
+
+// Rewrites the pack with the newest entries first (this session's thumbs, then entries
+// hit this session, then the rest) until 3/4 of the limit. Entries whose source changed
+// are never hit again, so they are the first to fall out.
+void ThumbDiskCache::Compact0()
+{
+    if(IsNull(path)) return;
+    String tmp = path + ".tmp";
+    int64 budget = max_bytes * 3 / 4;
+    {
+        FileOut out(tmp);
+        if(!out) return;
+        PutHeader(out);
+        Index<String> written;
+        auto put = [&](const String& key, Size sz, const RGBA *pixels) {
+            int64 len = 12 + key.GetCount() + (int64)sz.cx * sz.cy * sizeof(RGBA);
+            if(written.Find(key) >= 0 || out.GetSize() + len > budget) return;
+            PutRecord(out, key, sz, pixels);
+            written.Add(key);
+        };
+        for(int i = fresh.GetCount() - 1; i >= 0; --i)
+            put(fresh.GetKey(i), fresh[i].GetSize(), fresh[i].Begin());
+        if(map.IsOpen())
+            for(int pass = 0; pass < 2; ++pass)
+                for(int i = index.GetCount() - 1; i >= 0; --i)
+                    if(used[i] == (pass == 0)) {
+                        const Entry& e = index[i];
+                        put(index.GetKey(i), e.size, (const RGBA *)(map.Begin() + e.offset));
+                    }
+    }
+    map.Close();
+    fresh.Clear();
+    fresh_bytes = 0;
+    if(!GalleryReplaceFile(tmp, path))
+        DeleteFile(tmp); // the old pack stays in use
+    MapIndex();
+}
+
+bool GalleryReplaceFile(const String& tmp, const String& path)
+{
+#ifdef PLATFORM_POSIX
+    return FileMove(tmp, path); // rename() replaces path atomically
+#else
+    String bak = path + ".bak"; // MoveFile does not replace: step the old file aside first
+    DeleteFile(bak);
+    if(FileExists(path) && !FileMove(path, bak))
+        return false;
+    if(!FileMove(tmp, path)) {
+        FileMove(bak, path);
+        return false;
+    }
+    DeleteFile(bak);
+    return true;
+#endif
+}
@@ -0,0 +1,142 @@
+#include "IconGalleryCtrl.h"
+
+static StaticMutex sAtlasLock;
+
+static ArrayMap<int64, Image>& sAtlas() { static ArrayMap<int64, Image> m; return m; }
+
+// (status, gray, tile, seed rgb) packed into one key
+static int64 AtlasKey(int kind, int tile, bool gray, Color seed) {
+    int64 rgb = IsNull(seed) ? 0 : (seed.GetR() << 16) | (seed.GetG() << 8) | seed.GetB();
+    return ((int64)kind << 40) | ((int64)gray << 39) | ((int64)tile << 24) | rgb;
+}
+
+enum { ATLAS_CHECKER = 15 }; // pseudo-status for the bare checkerboard
+
+// ---------------- Glyph primitives ----------------
+static void DrawPlaceholderGlyph(BufferPainter& p, int tile, bool gray) {
+    Color edge = gray ? SColorDisabled() : SColorText();
+    int   m    = max(2, tile / 10);
+    int   t    = max(1, tile / 16);
+    int dash = max(2, tile / 12);
+    int gap  = dash;
+
+    for(int x = m; x < tile - m; x += dash + gap) {
+        int w = min(dash, tile - m - x);
+        p.Rectangle(x, m, w, t).Fill(edge);
+        p.Rectangle(x, tile - m - t, w, t).Fill(edge);
+    }
+    for(int y = m; y < tile - m; y += dash + gap) {
+        int h = min(dash, tile - m - y);
+        p.Rectangle(m, y, t, h).Fill(edge);
+        p.Rectangle(tile - m - t, y, t, h).Fill(edge);
+    }
+    int cx = tile / 2, cy = tile / 2, arm = (tile - 2*m) / 3;
+    p.Rectangle(cx - t/2, cy - arm, t, 2*arm).Fill(edge);
+    p.Rectangle(cx - arm, cy - t/2, 2*arm, t).Fill(edge);
+}
+
+static void DrawMissingGlyph(BufferPainter& p, int tile, bool gray) {
+    const Color warn = gray ? SColorDisabled() : Color(200, 60, 60);
+    const int   m    = max(2, tile / 10);
+    const int   t    = max(2, tile / 14);
+
+    p.Rectangle(m, m,                tile - 2*m, t          ).Fill(warn);
+    p.Rectangle(m, tile - m - t,     tile - 2*m, t          ).Fill(warn);
+    p.Rectangle(m, m,                t,          tile - 2*m ).Fill(warn);
+    p.Rectangle(tile - m - t, m,     t,          tile - 2*m ).Fill(warn);
+
+    const int cx   = tile / 2;
+    const int barh = (tile - 2*m) * 2 / 3;
+    const int dot  = max(2, t);
+
+    p.Rectangle(cx - t/2,
+                m + (tile - 2*m - barh)/2,
+                t,
+                barh - 2*dot).Fill(warn);
+
+    p.Rectangle(cx - dot/2,
+                m + (tile - 2*m - dot)/2 + barh - dot,
+                dot,
+                dot).Fill(warn);
+}
+
+
+// ---------------- Tile builders (run outside the lock) ----------------
+static Image MakeChecker(int tile) {
+    const RGBA a = Color(24,28,34), b = Color(18,22,27);
+    const int step = 8;
+    ImageBuffer ib(tile, tile);
+    for(int y = 0; y < tile; ++y) {
+        RGBA* t = ib[y];
+        int odd = (y / step) & 1;
+        for(int x = 0; x < tile; ++x)
+            t[x] = ((x / step + odd) & 1) ? a : b;
+    }
+    ib.SetKind(IMAGE_OPAQUE);
+    return ib;
+}
+
+static Image MakeTile(ThumbStatus s, int tile, bool gray, Color seed) {
+    const Image& ck = GalleryTileAtlas::Checker(tile);
+    ImageBuffer ib(tile, tile);
+    memcpy(ib.Begin(), ck.Begin(), tile * tile * sizeof(RGBA));
+
+    if(s == ThumbStatus::Auto) {
+        RGBA c = gray ? GalleryTileAtlas::GrayOf(seed) : seed;
+        int m = max(2, tile / 8);
+        for(int y = m; y < tile - m; ++y) {
+            RGBA* t = ib[y];
+            for(int x = m; x < tile - m; ++x) t[x] = c;
+        }
+    }
+    else {
+        BufferPainter bp(ib);
+        if(s == ThumbStatus::Placeholder) DrawPlaceholderGlyph(bp, tile, gray);
+        else                              DrawMissingGlyph(bp, tile, gray);
+    }
+    return ib;
+}
+
+// ---------------- Lookup ----------------
+static const Image& AtlasGet(int64 key, Function<Image ()> make) {
+    {
+        Mutex::Lock __(sAtlasLock);
+        int q = sAtlas().Find(key);
+        if(q >= 0) return sAtlas()[q];
+    }
+    Image m = make(); // built unlocked; if two threads race, the first insert wins
+    Mutex::Lock __(sAtlasLock);
+    int q = sAtlas().Find(key);
+    return q >= 0 ? sAtlas()[q] : sAtlas().Add(key, m);
+}
+
+const Image& GalleryTileAtlas::Checker(int tile) {
+    return AtlasGet(AtlasKey(ATLAS_CHECKER, tile, false, Null), [=] { return MakeChecker(tile); });
+}
+
+const Image& GalleryTileAtlas::Get(ThumbStatus s, int tile, bool gray, Color seed) {
+    if(s != ThumbStatus::Auto) seed = Null; // glyphs do not depend on the seed
+    return AtlasGet(AtlasKey((int)s, tile, gray, seed), [=] { return MakeTile(s, tile, gray, seed); });
+}
+
+Image GalleryTileAtlas::Build(ThumbStatus s, int tile, bool gray, Color seed) {
+    return MakeTile(s, tile, gray, seed);
+}
+
+Color GalleryTileAtlas::GrayOf(Color c) {
+    int lum = (c.GetR()*30 + c.GetG()*59 + c.GetB()*11) / 100;
+    return Color(lum, lum, lum);
+}
+
+int GalleryTileAtlas::GetCount() {
+    Mutex::Lock __(sAtlasLock);
+    return sAtlas().GetCount();
+}
+
+int64 GalleryTileAtlas::GetBytes() {
+    Mutex::Lock __(sAtlasLock);
+    int64 n = 0;
+    for(const Image& m : sAtlas())
+        n += (int64)m.GetLength() * sizeof(RGBA);
+    return n;
+}
@@ -0,0 +1,256 @@
+#pragma once
+#include <CtrlLib/CtrlLib.h>
+#include <Painter/Painter.h>
+using namespace Upp;
+
+// ---------- Glyph rasterization ----------
+// 8-bit anti-aliased coverage of one glyph, centred in a px x px cell
+struct GlyphMask : Moveable<GlyphMask> {
+    Size         size = Size(0, 0);
+    Vector<byte> coverage;          // size.cx * size.cy, row-major
+    int          stamp = 0;         // last Prefetch round that used it
+};
+
+struct GlyphKey : Moveable<GlyphKey> {
+    Font  font;                     // face and style; the height comes from px
+    int   codepoint = 0;
+    int   px        = 0;
+    int   rot       = 0;            // rotation bucket, GlyphCache::ROTATION_STEP degrees each
+
+    bool   operator==(const GlyphKey& b) const { return font == b.font && codepoint == b.codepoint && px == b.px && rot == b.rot; }
+    hash_t GetHashValue() const               { return CombineHash(font, codepoint, px, rot); }
+};
+
+// Outlines are rasterized once per key; color, opacity and offsets are applied to the cached
+// masks by IconCompositor. Not thread-safe: one thread at a time uses a cache, so the gallery
+// render on the scheduler worker has its own. Prefetch rasterizes its misses in parallel.
+class GlyphCache {
+public:
+    enum { ROTATION_STEP = 3 };
+
+    static GlyphKey MakeKey(Font font, int codepoint, int px, int rotation_deg);
+    static void     Rasterize(const GlyphKey& k, GlyphMask& m);
+
+    void             Prefetch(const Vector<GlyphKey>& keys); // call once per paint, before Get
+    const GlyphMask& Get(const GlyphKey& k);                 // rasterizes on a miss
+
+    void   SetMaxBytes(int64 n)    { max_bytes = n; }
+    int64  GetBytes() const        { return bytes; }
+    int    GetCount() const        { return map.GetCount(); }
+    int    GetHits() const         { return hits; }
+    int    GetMisses() const       { return misses; }
+    void   Clear()                 { map.Clear(); bytes = 0; }
+
+private:
+    ArrayMap<GlyphKey, GlyphMask> map;
+    int64  bytes     = 0;
+    int64  max_bytes = 32 << 20;
+    int    round     = 0;
+    int    hits      = 0;
+    int    misses    = 0;
+
+    void   Trim();
+};
+
+// ---------- Icon document ----------
+struct IconLayer : Moveable<IconLayer> {
+    Font   font      = Serif();
+    int    codepoint = 0x2605;      // ★
+    Color  fg        = White();
+    int    opacity   = 255;
+    int    rotate    = 0;           // degrees
+    int    scale     = 100;         // percent of the cell
+    Point  offset    = Point(0, 0); // per mille of the cell
+    bool   visible   = true;
+};
+
+struct IconDoc {
+    IconLayer layer[2];             // A (top), B (bottom)
+    Color     background = Null;    // Null = transparent
+
+    IconDoc();
+
+    GlyphKey Key(int li, int px) const;
+    void     Keys(int px, Vector<GlyphKey>& out) const;
+};
+
+// ---------- Compositing ----------
+// Premultiplied source-over of count pixels with a global opacity (0..255), SSE2 when the
+// build allows it
+void BlendOverRGBA(RGBA *t, const RGBA *s, int count, int opacity = 255);
+
+// The composited icon per output size, rebuilt incrementally. Each size keeps the layers'
+// colored rasters and the stack of partial composites (background + B, then + A). Get
+// compares the document with the state they were built from: only a layer whose glyph or
+// color changed is re-colored (rotation and scale pick a new mask through the GlyphCache),
+// and blending restarts from the lowest changed level, so an opacity or offset change of A
+// is one blend over the cached background + B. The document needs no change notifications.
+// One thread at a time: the stage's runs on the GUI thread, the gallery's on the scheduler
+// worker over a document snapshot that the job owns while it runs.
+class IconCompositor {
+public:
+    enum { MAX_SURFACES = 12 };
+
+    IconCompositor(const IconDoc& doc, GlyphCache& cache) : doc(doc), cache(cache) {}
+
+    void         Prefetch(const Vector<int>& sizes); // once per paint, before Get
+    const Image& Get(int px);                        // valid until the next Get
+    void         Clear()                  { surface.Clear(); }
+
+    int    GetRasters() const             { return rasters; } // layer rasters re-colored ...
+    int    GetBlends() const              { return blends; }  // ... and stack levels re-blended
+
+private:
+    struct Surface {
+        GlyphKey key[2];            // per layer (A, B): what raster was built from
+        Color    fg[2];
+        Image    raster[2];         // fg-colored mask at full opacity, not offset
+        bool     shown[2] = { false, false };
+        int      opacity[2] = { 0, 0 };
+        Point    offset[2];
+        Color    background;
+        Image    stack[2];          // [0] background + B, [1] + A: the icon
+        int      stamp = 0;
+    };
+
+    const IconDoc&         doc;
+    GlyphCache&            cache;
+    ArrayMap<int, Surface> surface; // by px
+    int                    round   = 0;
+    int                    rasters = 0;
+    int                    blends  = 0;
+
+    void   Trim();
+};
+
+// ---------- Render scheduling ----------
+// Edits only mark outputs dirty; a frame tick renders each dirty output at most once, in
+// priority order (stage, previews, gallery). Sync outputs render on the GUI thread, usually
+// a Refresh, and report Presented from their Paint. Async outputs snapshot their inputs on
+// the GUI thread, render on a worker with one job in flight per output, and apply the result
+// on the GUI thread. A result whose output was edited again meanwhile is dropped, and the
+// output is rendered once more with the latest state. Latency runs from the first edit a
+// render covers until its pixels are presented. GUI thread only, except Job::work.
+class RenderScheduler {
+public:
+    enum Output { STAGE, PREVIEWS, GALLERY, OUTPUT_COUNT };
+    enum { ALL = (1 << OUTPUT_COUNT) - 1, LATENCY_SAMPLES = 120 };
+
+    struct Job {                       // from an async output's prepare, on the GUI thread
+        Function<void ()> work;        // worker thread, must only touch the snapshot
+        Event<>           apply;       // GUI thread, only while still current
+    };
+
+    void   SetSync(int out, Event<> render)             { slot[out].render = render; }
+    void   SetAsync(int out, Function<Job ()> prepare)  { slot[out].prepare = prepare; }
+    void   SetFrameTime(int us)                         { frame_us = max(us, 1000); }
+
+    void   Edit(dword outputs = ALL);  // bit mask of 1 << Output
+    void   Cancel(int out);            // drops a pending or in-flight render, schedules none
+    void   Presented(int out);         // a sync output painted; no-op without a pending render
+    void   Flush();                    // renders everything now and waits for the workers
+
+    int64  GetLatency(int out, int percent = 50) const; // us, over the last LATENCY_SAMPLES
+    int    GetRenders(int out) const   { return slot[out].renders; }
+    int    GetDropped(int out) const   { return slot[out].dropped; } // superseded async results
+    int    GetEdits() const            { return edits; }
+    bool   IsIdle() const;
+
+private:
+    struct Slot {
+        Event<>           render;
+        Function<Job ()>  prepare;
+        bool              dirty   = false;
+        int64             edit_us = 0;  // first edit not rendered yet
+        int64             wait_us = 0;  // first edit of the render waiting to be presented
+        int               gen     = 0;  // edits so far; older async results are dropped
+        int               job_gen = 0;
+        bool              busy    = false;
+        std::atomic<bool> done { false };
+        Job               job;
+        BiVector<int64>   latency;
+        int               renders = 0;
+        int               dropped = 0;
+    };
+
+    Slot         slot[OUTPUT_COUNT];
+    int          frame_us  = 16667;
+    int64        last_run  = 0;
+    int          edits     = 0;
+    bool         scheduled = false;
+    TimeCallback tick;
+    CoWork       work;                 // declared last: joined before the slots go away
+
+    void   Kick();
+    void   Run();
+    void   Land(Slot& s);
+    void   Record(Slot& s, int64 since);
+};
+
+// ---------- Panes ----------
+class StageCtrl : public Ctrl {
+public:
+    Event<> WhenPaint;              // after the icon is on screen
+
+    StageCtrl(IconCompositor& icon) : icon(icon) { BackPaint(); }
+
+    void  SetChecker(bool b)        { checker = b; Refresh(); }
+    bool  GetChecker() const        { return checker; }
+
+    void  Paint(Draw& w) override;
+
+private:
+    IconCompositor& icon;
+    bool            checker = true;
+};
+
+// The icon at every output size, side by side at 1:1
+class PreviewSizesCtrl : public Ctrl {
+public:
+    Event<> WhenPaint;
+
+    PreviewSizesCtrl(IconCompositor& icon) : icon(icon) { BackPaint(); }
+
+    void  Paint(Draw& w) override;
+
+private:
+    IconCompositor& icon;
+};
+
+// One layer's properties; every change is written straight into the layer and fires WhenEdit
+class LayerEditor : public ParentCtrl {
+public:
+    Event<> WhenEdit;
+
+    LayerEditor();
+    void  Bind(IconLayer& l)        { layer = &l; Load(); }
+    void  Load();                   // controls from the layer
+
+private:
+    IconLayer  *layer = nullptr;
+    Label       label[8];
+    Option      visible;
+    EditString  glyph;              // the character itself, or U+XXXX
+    ColorPusher fg;
+    SliderCtrl  opacity, scale, rotate, dx, dy;
+
+    void  Store();
+};
+
+// The Layer Tabs pane: one editor per layer, A on top
+class LayerPanel : public ParentCtrl {
+public:
+    Event<> WhenEdit;
+
+    LayerPanel(IconDoc& doc);
+    void  Load()                    { for(LayerEditor& e : editor) e.Load(); }
+
+private:
+    TabCtrl     tabs;
+    LayerEditor editor[2];
+};
+
+int  StudioOutputSize(int i);       // 16, 32, 64, 128, 256
+int  StudioOutputSizeCount();
+const Image& StudioChecker(Size sz, int cell); // cached per (size, cell)
+void DrawStudioChecker(Draw& w, const Rect& r, int cell = 8);
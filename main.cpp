@@ -2,11 +2,13 @@
 using namespace Upp;
 
 #include <IconGalleryCtrl/IconGalleryCtrl.h>   // package header
+#include "include/IconStudio.h"
 
 struct TopBar : public ParentCtrl {
     Label    lbl;
     DropList output;
-    Button   exportBtn, saveBtn;
+    Button   exportBtn, atlasBtn, saveBtn;
+    ProgressIndicator progress;
 
     TopBar() {
         BackPaint();
@@ -15,14 +17,21 @@ struct TopBar : public ParentCtrl {
         lbl.SetText("Output");
 
         Add(output.LeftPos(92, 100).VCenterPos(24));
-        for(int s : {16,32,64,128,256}) output.Add(s);
+        for(int i = 0; i < StudioOutputSizeCount(); ++i) output.Add(StudioOutputSize(i));
+        output.Add(0, "All sizes");
         output.SetData(64);
 
         Add(exportBtn.LeftPos(200, 110).VCenterPos(24));
         exportBtn.SetLabel("Export PNG");
 
-        Add(saveBtn.LeftPos(316, 90).VCenterPos(24));
+        Add(atlasBtn.LeftPos(316, 110).VCenterPos(24));
+        atlasBtn.SetLabel("Export Atlas");
+
+        Add(saveBtn.LeftPos(432, 90).VCenterPos(24));
         saveBtn.SetLabel("Save");
+
+        Add(progress.LeftPos(528, 160).VCenterPos(16));
+        progress.Hide();
     }
 
     void Paint(Draw& w) override {
@@ -50,7 +59,93 @@ class MainWin : public TopWindow {
     Pane           left   {"Preview Sizes"};
     Pane           center {"Stage"};
     Pane           right  {"Layer Tabs"};
+    GlyphCache     glyphs;        // shared by the stage and the previews
+    IconDoc        doc;
+    IconCompositor icon     {doc, glyphs};
+    StageCtrl      stage    {icon};
+    PreviewSizesCtrl previews {icon};
+    ThumbDiskCache thumb_cache;   // outlives gallery (declared first)
+    GalleryLibrary library;       // likewise; the gallery reads thumbnails from its mapping
     IconGalleryCtrl gallery;
+    GalleryExporter exporter;     // joins its workers before the gallery goes away
+    LayerPanel     layers   {doc};
+    IconDoc        gallery_doc;   // snapshot the gallery thumbnail is rendered from, off the GUI thread
+    GlyphCache     gallery_glyphs;
+    IconCompositor gallery_icon {gallery_doc, gallery_glyphs};
+    Image          gallery_thumb;
+    RenderScheduler scheduler;    // last: joins its worker before the snapshot goes away
+
+    Vector<int> OutputSizes() {
+        Vector<int> sizes;
+        int px = ~topbar.output;
+        if(px > 0)
+            sizes.Add(px);
+        else
+            for(int i = 0; i < StudioOutputSizeCount(); ++i) sizes.Add(StudioOutputSize(i));
+        return sizes;
+    }
+
+    // Writes the selected gallery icons to <dir>/<px>/<name>.png; the button cancels while running
+    void ExportSelection() {
+        if(exporter.IsRunning()) {
+            exporter.Cancel();
+            return;
+        }
+        Vector<int> sel = gallery.GetSelection();
+        if(sel.IsEmpty()) {
+            PromptOK("Select the icons to export in the gallery first.");
+            return;
+        }
+        String dir = SelectDirectory();
+        if(IsNull(dir)) return;
+        if(!exporter.Start(GalleryExporter::Snapshot(gallery, sel), OutputSizes(), dir)) {
+            Exclamation("Cannot create the export folders in [* " + DeQtf(dir) + "].");
+            return;
+        }
+        topbar.exportBtn.SetLabel("Cancel");
+        topbar.progress.Set(0, exporter.GetTotal());
+        topbar.progress.Show();
+    }
+
+    // One packed sheet per output size with atlas_<px>.json/.igat indexes; the selection, or everything
+    void ExportAtlas() {
+        Vector<int> sel = gallery.GetSelection();
+        if(sel.IsEmpty())
+            for(int i = 0; i < gallery.GetCount(); ++i) sel.Add(i);
+        if(sel.IsEmpty()) return;
+        String dir = SelectDirectory();
+        if(IsNull(dir)) return;
+        WaitCursor wc;
+        if(!GalleryExportAtlas(GalleryExporter::Snapshot(gallery, sel), OutputSizes(), dir))
+            Exclamation("Cannot write the atlas files to [* " + DeQtf(dir) + "].");
+    }
+
+    // The edited icon becomes the thumbnail of the first selected gallery item. Runs with no
+    // gallery job in flight, so the snapshot is free to overwrite.
+    RenderScheduler::Job GalleryThumbJob() {
+        RenderScheduler::Job job;
+        Vector<int> sel = gallery.GetSelection();
+        if(sel.IsEmpty() || gallery.IsVirtual()) return job;
+        int item = sel[0];
+        int px = gallery.GetTileSize(gallery.GetZoomCount() - 1);
+        gallery_doc = doc;
+        job.work  = [=] { gallery_thumb = gallery_icon.Get(px); };
+        job.apply = [=] { gallery.SetThumbImage(item, gallery_thumb); };
+        return job;
+    }
+
+    void SaveLibrary() {
+        if(exporter.IsRunning()) { // the export reads library records as it goes
+            PromptOK("Wait for the export to finish before saving.");
+            return;
+        }
+        WaitCursor wc;
+        if(!library.IsOpen())
+            library.Open(ConfigFile("library.iglb"));
+        if(!gallery.SaveLibrary(library))
+            Exclamation("The icon library could not be saved.");
+    }
+
 public:
     MainWin() {
         Title("Font Icon Studio Pro — U++ Scaffold");
@@ -62,14 +157,46 @@ public:
         Add(center);
         Add(right);
         Add(gallery);
-
-        // Seed gallery with dummies
-        for(int i = 0; i < 500; ++i)
-            gallery.AddDummy(Format("Icon %d", i));
+        left.Add(previews.HSizePos().VSizePos(25, 0));   // below the pane header
+        center.Add(stage.HSizePos().VSizePos(25, 0));
+        right.Add(layers.HSizePos().VSizePos(25, 0));
+
+        thumb_cache.Open(ConfigFile("thumbs.igtc"));
+        gallery.SetDiskCache(&thumb_cache);
+
+        // The saved library, or dummies on first run (one batch, one layout pass)
+        if(!library.Open(ConfigFile("library.iglb")))
+            Exclamation("The icon library could not be read and was left untouched.");
+        if(library.GetCount())
+            gallery.OpenLibrary(library);
+        else {
+            Vector<String> names;
+            for(int i = 0; i < 500; ++i)
+                names.Add(Format("Icon %d", i));
+            gallery.AddRange(names);
+        }
 
         // Simple actions
-        topbar.exportBtn.WhenAction = [] { PromptOK("Export PNG (stub)"); };
-        topbar.saveBtn.WhenAction   = [] { PromptOK("Save (stub)"); };
+        topbar.exportBtn.WhenAction = [=] { ExportSelection(); };
+        exporter.WhenProgress = [=](int done, int total) { topbar.progress.Set(done, total); };
+        exporter.WhenDone = [=] {
+            topbar.progress.Hide();
+            topbar.exportBtn.SetLabel("Export PNG");
+            if(exporter.GetFailed())
+                Exclamation(Format("%d of %d files could not be exported (unreadable source or write error).", exporter.GetFailed(), exporter.GetTotal()));
+        };
+        topbar.atlasBtn.WhenAction  = [=] { ExportAtlas(); };
+        topbar.saveBtn.WhenAction   = [=] { SaveLibrary(); };
+
+        // Layer edits render each output at most once per frame, the gallery thumb off the GUI thread
+        layers.WhenEdit = [=] { scheduler.Edit(); };
+        scheduler.SetSync(RenderScheduler::STAGE, [=] { stage.Refresh(); });
+        scheduler.SetSync(RenderScheduler::PREVIEWS, [=] { previews.Refresh(); });
+        scheduler.SetAsync(RenderScheduler::GALLERY, [=] { return GalleryThumbJob(); });
+        // The job targets an item index; a selection change (removals notify one too) retires it
+        gallery.WhenSelection = [=] { scheduler.Cancel(RenderScheduler::GALLERY); };
+        stage.WhenPaint    = [=] { scheduler.Presented(RenderScheduler::STAGE); };
+        previews.WhenPaint = [=] { scheduler.Presented(RenderScheduler::PREVIEWS); };
     }
 
     void Layout() override {
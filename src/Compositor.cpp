@@ -0,0 +1,153 @@
+#include "../include/IconStudio.h"
+
+#ifdef CPU_SSE2
+#include <emmintrin.h>
+#endif
+
+// ---------------- Blend kernel ----------------
+// Premultiplied source-over: d = s * op + d * (1 - s.a * op), all in 0..256 fixed point.
+// The result never exceeds 255, so the scalar path needs no clamping either.
+static void BlendOverScalar(RGBA*& t, const RGBA*& s, int& n, int op)
+{
+    for(; n > 0; --n, ++s, ++t) {
+        int a = (s->a * op) >> 8;
+        if(!a) continue;
+        int ia = 256 - (a + (a >> 7));
+        t->r = byte(((s->r * op) >> 8) + ((t->r * ia) >> 8));
+        t->g = byte(((s->g * op) >> 8) + ((t->g * ia) >> 8));
+        t->b = byte(((s->b * op) >> 8) + ((t->b * ia) >> 8));
+        t->a = byte(a + ((t->a * ia) >> 8));
+    }
+}
+
+#ifdef CPU_SSE2
+// Two pixels per 16-bit half; the alpha lane is picked by member offset, as RGBA channel
+// order differs between platforms
+static inline __m128i BlendOver2(__m128i s, __m128i d, __m128i op, __m128i c256)
+{
+    enum { A = offsetof(RGBA, a) };
+    s = _mm_srli_epi16(_mm_mullo_epi16(s, op), 8);
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(A, A, A, A)), _MM_SHUFFLE(A, A, A, A));
+    a = _mm_sub_epi16(c256, _mm_add_epi16(a, _mm_srli_epi16(a, 7)));
+    return _mm_add_epi16(s, _mm_srli_epi16(_mm_mullo_epi16(d, a), 8));
+}
+
+static void BlendOverSSE2(RGBA*& t, const RGBA*& s, int& n, int op)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vop  = _mm_set1_epi16(op);
+    const __m128i c256 = _mm_set1_epi16(256);
+    for(; n >= 4; n -= 4, s += 4, t += 4) {
+        __m128i sp = _mm_loadu_si128((const __m128i *)s);
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(sp, zero)) == 0xffff)
+            continue; // transparent run, common around glyphs
+        __m128i dp = _mm_loadu_si128((const __m128i *)t);
+        __m128i lo = BlendOver2(_mm_unpacklo_epi8(sp, zero), _mm_unpacklo_epi8(dp, zero), vop, c256);
+        __m128i hi = BlendOver2(_mm_unpackhi_epi8(sp, zero), _mm_unpackhi_epi8(dp, zero), vop, c256);
+        _mm_storeu_si128((__m128i *)t, _mm_packus_epi16(lo, hi));
+    }
+}
+#endif
+
+void BlendOverRGBA(RGBA *t, const RGBA *s, int n, int opacity)
+{
+    int op = minmax(opacity, 0, 255);
+    op += op >> 7; // 0..256
+    if(!op) return;
+#ifdef CPU_SSE2
+    BlendOverSSE2(t, s, n, op);
+#endif
+    BlendOverScalar(t, s, n, op); // tail (or everything without SIMD)
+}
+
+// ---------------- Compositor ----------------
+// The mask in fg, premultiplied, at full opacity
+static Image Colorize(const GlyphMask& m, Color fg)
+{
+    ImageBuffer ib(m.size);
+    int r = fg.GetR(), g = fg.GetG(), b = fg.GetB();
+    RGBA *t = ib.Begin();
+    for(byte c : m.coverage) {
+        int a = c + (c >> 7); // 0..256
+        t->r = byte((r * a) >> 8);
+        t->g = byte((g * a) >> 8);
+        t->b = byte((b * a) >> 8);
+        t->a = c;
+        t++;
+    }
+    return ib;
+}
+
+void IconCompositor::Prefetch(const Vector<int>& sizes)
+{
+    Vector<GlyphKey> keys;
+    for(int px : sizes)
+        doc.Keys(px, keys);
+    cache.Prefetch(keys);
+}
+
+const Image& IconCompositor::Get(int px)
+{
+    bool fresh = surface.Find(px) < 0;
+    Surface& s = surface.GetAdd(px);
+    s.stamp = ++round;
+
+    // Lowest stack level whose inputs changed; level 0 blends B, level 1 blends A
+    int dirty = fresh || s.background != doc.background ? 0 : 2;
+    s.background = doc.background;
+    for(int level = 0; level < 2; ++level) {
+        int li = 1 - level;
+        const IconLayer& l = doc.layer[li];
+        bool shown = l.visible && l.opacity > 0;
+        bool changed = shown != s.shown[li];
+        if(shown) {
+            GlyphKey k = doc.Key(li, px);
+            if(s.raster[li].IsEmpty() || !(s.key[li] == k) || s.fg[li] != l.fg) {
+                s.raster[li] = Colorize(cache.Get(k), l.fg);
+                s.key[li] = k;
+                s.fg[li] = l.fg;
+                rasters++;
+                changed = true;
+            }
+            changed = changed || l.opacity != s.opacity[li] || l.offset != s.offset[li];
+        }
+        s.shown[li]   = shown;
+        s.opacity[li] = l.opacity;
+        s.offset[li]  = l.offset;
+        if(changed)
+            dirty = min(dirty, level);
+    }
+
+    for(int level = dirty; level < 2; ++level) {
+        ImageBuffer ib(px, px);
+        if(level == 0)
+            Fill(ib.Begin(), IsNull(doc.background) ? RGBAZero() : (RGBA)doc.background, ib.GetLength());
+        else
+            memcpy(ib.Begin(), s.stack[level - 1].Begin(), ib.GetLength() * sizeof(RGBA));
+        int li = 1 - level;
+        if(s.shown[li]) {
+            const Image& m = s.raster[li];
+            Size msz = m.GetSize();
+            int x0 = (px - msz.cx) / 2 + s.offset[li].x * px / 1000;
+            int y0 = (px - msz.cy) / 2 + s.offset[li].y * px / 1000;
+            int xa = max(0, -x0), xb = min(msz.cx, px - x0);
+            for(int y = max(0, -y0); y < min(msz.cy, px - y0) && xa < xb; ++y)
+                BlendOverRGBA(ib[y + y0] + x0 + xa, m[y] + xa, xb - xa, s.opacity[li]);
+        }
+        s.stack[level] = ib;
+        blends++;
+    }
+    Trim();
+    return s.stack[1];
+}
+
+// The stage size follows the pane, so sizes seen while resizing are dropped oldest first
+void IconCompositor::Trim()
+{
+    while(surface.GetCount() > MAX_SURFACES) {
+        int q = 0;
+        for(int i = 1; i < surface.GetCount(); ++i)
+            if(surface[i].stamp < surface[q].stamp) q = i;
+        surface.Remove(q);
+    }
+}
@@ -0,0 +1,105 @@
+#include "../include/IconStudio.h"
+
+GlyphKey GlyphCache::MakeKey(Font font, int codepoint, int px, int rotation_deg)
+{
+    GlyphKey k;
+    k.font = font;
+    k.font.Height(0); // not part of the identity, px is
+    k.codepoint = codepoint;
+    k.px = px;
+    k.rot = (((rotation_deg % 360) + 360) % 360 + ROTATION_STEP / 2) / ROTATION_STEP % (360 / ROTATION_STEP);
+    return k;
+}
+
+// Fits the glyph into 90% of the cell, rotated about the cell centre
+void GlyphCache::Rasterize(const GlyphKey& k, GlyphMask& m)
+{
+    int px = max(k.px, 1);
+    m.size = Size(px, px);
+    m.coverage.SetCount(px * px);
+
+    WString text(k.codepoint, 1);
+    Font f = k.font;
+    f.Height(px);
+    Size tsz = GetTextSize(text, f);
+    if(tsz.cx <= 0 || tsz.cy <= 0) {
+        memset(m.coverage.begin(), 0, px * px);
+        return;
+    }
+
+    ImageBuffer ib(px, px);
+    Fill(ib.Begin(), RGBAZero(), ib.GetLength());
+    {
+        BufferPainter sw(ib, MODE_ANTIALIASED);
+        double s = 0.9 * px / max(tsz.cx, tsz.cy);
+        sw.Translate(px / 2.0, px / 2.0);
+        sw.Rotate(k.rot * ROTATION_STEP * M_PI / 180);
+        sw.Scale(s);
+        sw.Text(-tsz.cx / 2.0, -tsz.cy / 2.0, text, f).Fill(White());
+    }
+    const RGBA *s = ib.Begin();
+    for(byte& c : m.coverage)
+        c = (s++)->a;
+}
+
+// Drops the least recently prefetched masks once over budget; never the current round's
+void GlyphCache::Trim()
+{
+    if(bytes <= max_bytes) return;
+    Vector<int> by_age;
+    for(int i = 0; i < map.GetCount(); ++i) by_age.Add(i);
+    Sort(by_age, [&](int a, int b) { return map[a].stamp < map[b].stamp; });
+    for(int i : by_age) {
+        if(bytes <= max_bytes || map[i].stamp >= round) break;
+        bytes -= map[i].coverage.GetCount();
+        map.Unlink(i);
+    }
+    map.Sweep();
+}
+
+void GlyphCache::Prefetch(const Vector<GlyphKey>& keys)
+{
+    round++;
+    Vector<int> miss;
+    for(int i = 0; i < keys.GetCount(); ++i) {
+        int q = map.Find(keys[i]);
+        if(q >= 0)
+            map[q].stamp = round;
+        else {
+            bool dup = false;
+            for(int j : miss) dup = dup || keys[j] == keys[i];
+            if(!dup) miss.Add(i);
+        }
+    }
+    if(miss.GetCount()) {
+        Array<GlyphMask> fresh;
+        fresh.SetCount(miss.GetCount());
+        CoPartition(0, miss.GetCount(), [&](int a, int b) {
+            for(int i = a; i < b; ++i)
+                Rasterize(keys[miss[i]], fresh[i]);
+        });
+        for(int i = 0; i < miss.GetCount(); ++i) {
+            GlyphMask& m = map.Add(keys[miss[i]], fresh.Detach(0));
+            m.stamp = round;
+            bytes += m.coverage.GetCount();
+            misses++;
+        }
+    }
+    Trim();
+}
+
+const GlyphMask& GlyphCache::Get(const GlyphKey& k)
+{
+    int q = map.Find(k);
+    if(q >= 0) {
+        hits++;
+        map[q].stamp = round;
+        return map[q];
+    }
+    misses++;
+    GlyphMask& m = map.Add(k);
+    Rasterize(k, m);
+    m.stamp = round;
+    bytes += m.coverage.GetCount();
+    return m;
+}
@@ -0,0 +1,20 @@
+#include "../include/IconStudio.h"
+
+IconDoc::IconDoc()
+{
+    layer[1].codepoint = 0x25CF; // ● backdrop
+    layer[1].fg = Color(38, 110, 200);
+}
+
+GlyphKey IconDoc::Key(int li, int px) const
+{
+    const IconLayer& l = layer[li];
+    return GlyphCache::MakeKey(l.font, l.codepoint, max(1, px * l.scale / 100), l.rotate);
+}
+
+void IconDoc::Keys(int px, Vector<GlyphKey>& out) const
+{
+    for(int li = 0; li < 2; ++li)
+        if(layer[li].visible && layer[li].opacity > 0)
+            out.Add(Key(li, px));
+}
@@ -0,0 +1,64 @@
+#include "../include/IconStudio.h"
+
+// ---------------- Layer editor ----------------
+LayerEditor::LayerEditor()
+{
+    static const char *text[] = { "Visible", "Glyph", "Color", "Opacity", "Size %", "Rotate", "Offset X", "Offset Y" };
+    Ctrl *field[] = { &visible, &glyph, &fg, &opacity, &scale, &rotate, &dx, &dy };
+    for(int i = 0; i < __countof(field); ++i) {
+        int y = 8 + i * 30;
+        Add(label[i].LeftPos(8, 72).TopPos(y, 24));
+        label[i].SetText(text[i]);
+        Add(field[i]->HSizePos(84, 8).TopPos(y, 24));
+        *field[i] << [=] { Store(); };
+    }
+    opacity.MinMax(0, 255);
+    scale.MinMax(10, 150);
+    rotate.MinMax(0, 359);
+    dx.MinMax(-500, 500);
+    dy.MinMax(-500, 500);
+}
+
+void LayerEditor::Load()
+{
+    if(!layer) return;
+    visible <<= layer->visible;
+    glyph <<= WString(layer->codepoint, 1).ToString();
+    fg <<= layer->fg;
+    opacity <<= layer->opacity;
+    scale <<= layer->scale;
+    rotate <<= layer->rotate;
+    dx <<= layer->offset.x;
+    dy <<= layer->offset.y;
+}
+
+void LayerEditor::Store()
+{
+    if(!layer) return;
+    WString g = TrimBoth((String)~glyph).ToWString();
+    if(g.GetCount() > 2 && ToUpper(g[0]) == 'U' && g[1] == '+') {
+        int c = ScanInt(g.Mid(2).ToString(), NULL, 16);
+        if(!IsNull(c) && c > 0) layer->codepoint = c;
+    }
+    else
+    if(g.GetCount())
+        layer->codepoint = g[0];
+    layer->visible = (bool)~visible;
+    if(!IsNull(~fg)) layer->fg = ~fg;
+    layer->opacity = (int)~opacity;
+    layer->scale   = (int)~scale;
+    layer->rotate  = (int)~rotate;
+    layer->offset  = Point((int)~dx, (int)~dy);
+    WhenEdit();
+}
+
+// ---------------- Panel ----------------
+LayerPanel::LayerPanel(IconDoc& doc)
+{
+    Add(tabs.SizePos());
+    for(int li = 0; li < 2; ++li) {
+        editor[li].Bind(doc.layer[li]);
+        editor[li].WhenEdit = [=] { WhenEdit(); };
+        tabs.Add(editor[li].SizePos(), li ? "B (back)" : "A (front)");
+    }
+}
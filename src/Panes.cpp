@@ -0,0 +1,74 @@
+#include "../include/IconStudio.h"
+
+static const int output_sizes[] = { 16, 32, 64, 128, 256 };
+
+int StudioOutputSize(int i)   { return output_sizes[i]; }
+int StudioOutputSizeCount()   { return __countof(output_sizes); }
+
+const Image& StudioChecker(Size sz, int cell)
+{
+    static ArrayMap<Tuple<Size, int>, Image> cache;
+    int q = cache.Find(MakeTuple(sz, cell));
+    if(q >= 0)
+        return cache[q];
+    if(cache.GetCount() > 32) // stage resizes
+        cache.Clear();
+    ImageBuffer ib(sz);
+    RGBA light = White(), dark = Color(204, 204, 204);
+    cell = max(cell, 1);
+    for(int y = 0; y < sz.cy; ++y) {
+        RGBA *t = ib[y];
+        for(int x = 0; x < sz.cx; ++x)
+            t[x] = (x / cell + y / cell) & 1 ? dark : light;
+    }
+    return cache.Add(MakeTuple(sz, cell), ib);
+}
+
+void DrawStudioChecker(Draw& w, const Rect& r, int cell)
+{
+    w.DrawImage(r.left, r.top, StudioChecker(r.GetSize(), cell));
+}
+
+// ---------------- Stage ----------------
+void StageCtrl::Paint(Draw& w)
+{
+    Size sz = GetSize();
+    w.DrawRect(sz, SColorPaper());
+    int px = minmax(min(sz.cx, sz.cy) - 32, 16, 512);
+    icon.Prefetch(Vector<int>{ px });
+    Rect r = RectC((sz.cx - px) / 2, (sz.cy - px) / 2, px, px);
+    if(checker)
+        DrawStudioChecker(w, r, max(4, px / 16));
+    w.DrawImage(r.left, r.top, icon.Get(px));
+    WhenPaint();
+}
+
+// ---------------- Preview sizes ----------------
+void PreviewSizesCtrl::Paint(Draw& w)
+{
+    Size sz = GetSize();
+    w.DrawRect(sz, SColorPaper());
+
+    Vector<int> sizes; // every size in one parallel pass, so all five update together
+    for(int i = 0; i < StudioOutputSizeCount(); ++i)
+        sizes.Add(StudioOutputSize(i));
+    icon.Prefetch(sizes);
+
+    Font fnt = StdFont().Height(Zy(10));
+    int x = 8, y = 8, rowh = 0;
+    for(int i = 0; i < StudioOutputSizeCount(); ++i) {
+        int s = StudioOutputSize(i);
+        if(x > 8 && x + s > sz.cx - 8) { // wrap
+            x = 8;
+            y += rowh + fnt.GetCy() + 12;
+            rowh = 0;
+        }
+        DrawStudioChecker(w, RectC(x, y, s, s), max(2, s / 8));
+        w.DrawImage(x, y, icon.Get(s));
+        String label = Format("%d px", s);
+        w.DrawText(x, y + s + 2, label, fnt, SColorDisabled());
+        x += max(s, GetTextSize(label, fnt).cx) + 12;
+        rowh = max(rowh, s);
+    }
+    WhenPaint();
+}
@@ -0,0 +1,133 @@
+#include "../include/IconStudio.h"
+
+void RenderScheduler::Edit(dword outputs)
+{
+    int64 now = usecs();
+    edits++;
+    for(int out = 0; out < OUTPUT_COUNT; ++out)
+        if(outputs & (1 << out)) {
+            Slot& s = slot[out];
+            s.dirty = true;
+            s.gen++;
+            if(!s.edit_us) s.edit_us = now;
+        }
+    Kick();
+}
+
+// The inputs of the output changed in a way that makes a render pointless, e.g. it targets
+// something that is gone: an in-flight result is dropped when it lands
+void RenderScheduler::Cancel(int out)
+{
+    Slot& s = slot[out];
+    s.gen++;
+    s.dirty = false;
+    s.edit_us = 0;
+}
+
+// One tick per frame at most: edits arriving faster than that coalesce into one render
+void RenderScheduler::Kick()
+{
+    if(scheduled) return;
+    scheduled = true;
+    int64 wait = max<int64>(0, last_run + frame_us - usecs());
+    tick.Set(int(wait / 1000), [=] { scheduled = false; Run(); });
+}
+
+void RenderScheduler::Run()
+{
+    last_run = usecs();
+    for(int out = 0; out < OUTPUT_COUNT; ++out) {
+        Slot& s = slot[out];
+        if(s.busy && s.done)
+            Land(s);
+        if(!s.dirty || s.busy) continue;
+        s.dirty = false;
+        s.renders++;
+        if(s.prepare) {
+            s.job = s.prepare();
+            s.job_gen = s.gen;
+            s.wait_us = s.edit_us;
+            s.done = false;
+            s.busy = true;
+            work & [=, &s] {
+                if(s.job.work) s.job.work();
+                s.done = true;
+            };
+        }
+        else {
+            if(!s.wait_us) s.wait_us = s.edit_us; // the previous render was never presented
+            s.render();
+        }
+        s.edit_us = 0;
+    }
+    if(!IsIdle())
+        Kick(); // poll the workers at frame rate
+}
+
+// Latest wins: an outdated result is dropped, and its edit time carries over to the render
+// that replaces it, so the latency still counts from the first edit
+void RenderScheduler::Land(Slot& s)
+{
+    s.busy = false;
+    if(s.job_gen == s.gen) {
+        s.job.apply();
+        Record(s, s.wait_us);
+    }
+    else {
+        s.dropped++;
+        if(s.dirty) // superseded rather than cancelled
+            s.edit_us = s.edit_us ? min(s.edit_us, s.wait_us) : s.wait_us;
+    }
+    s.wait_us = 0;
+    s.job = Job();
+}
+
+void RenderScheduler::Presented(int out)
+{
+    Slot& s = slot[out];
+    if(!s.prepare && s.wait_us) {
+        Record(s, s.wait_us);
+        s.wait_us = 0;
+    }
+}
+
+void RenderScheduler::Record(Slot& s, int64 since)
+{
+    if(!since) return;
+    s.latency.AddTail(usecs() - since);
+    while(s.latency.GetCount() > LATENCY_SAMPLES)
+        s.latency.DropHead();
+}
+
+void RenderScheduler::Flush()
+{
+    tick.Kill();
+    scheduled = false;
+    while(!IsIdle()) {
+        Run();
+        tick.Kill(); // Run re-kicks while busy; here the workers are waited for instead
+        scheduled = false;
+        work.Finish();
+        for(Slot& s : slot)
+            if(s.busy && s.done)
+                Land(s);
+    }
+}
+
+bool RenderScheduler::IsIdle() const
+{
+    for(const Slot& s : slot)
+        if(s.dirty || s.busy)
+            return false;
+    return true;
+}
+
+int64 RenderScheduler::GetLatency(int out, int percent) const
+{
+    const BiVector<int64>& l = slot[out].latency;
+    if(l.IsEmpty()) return 0;
+    Vector<int64> v;
+    for(int i = 0; i < l.GetCount(); ++i) v.Add(l[i]);
+    Sort(v);
+    return v[minmax(v.GetCount() * percent / 100, 0, v.GetCount() - 1)];
+}